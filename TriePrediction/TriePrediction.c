@@ -16,995 +16,8041 @@
 #include <stdlib.h>
 #include <stdbool.h>
 #include <ctype.h>
+#include <time.h>
+#include <math.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <stdarg.h>
+#include <limits.h>
+#include <errno.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+
+// vectorized scanning of letters, on x86-64 unless TRIE_SCALAR is defined
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(TRIE_SCALAR)
+#define TRIE_SIMD
+#include <immintrin.h>
+#endif
 
 // constants
 #define MAX_CHARACTERS (MAX_CHARACTERS_PER_WORD * MAX_WORDS_PER_LINE)
+#define READ_BLOCK_SIZE (1 << 20)
+#define OUTPUT_FLUSH_SIZE (1 << 16)
+#define BENCHMARK_OPERATIONS (1 << 20)
+#define BENCHMARK_SUCCESSORS 16
+#define ZIPF_EXPONENT 1.0
+#define FREEZE_MAX_FAILURES 16
+#define TOKEN_CHUNK_SIZE 32
+#define SERVER_EVENTS 64
+#define SERVER_BACKLOG_SIZE (1 << 20)
+#define SERVER_WAIT_MILLISECONDS 200
+#define CLIENT_DEFAULT_DEPTH 16
+#define SKETCH_DEPTH 4
+#define SKETCH_DEFAULT_CANDIDATES 8
+
+// instrumentation, compiled out unless TRIE_STATS is defined
+#ifdef TRIE_STATS
+#define COUNT_STAT(counter, amount) __atomic_fetch_add(&trieStats.counter, (amount), __ATOMIC_RELAXED)
+#define SET_STAT(counter, value) (trieStats.counter = (value))
+#else
+#define COUNT_STAT(counter, amount) ((void) 0)
+#define SET_STAT(counter, value) ((void) 0)
+#endif
+
+
+#ifdef TRIE_STATS
+/****************************************************************
+* Counters of the instrumentation layer, shared by all threads
+*/
+TrieStats trieStats;
+#endif
+
+/****************************************************************
+* Set by SIGINT or SIGTERM to stop the query server
+*/
+volatile sig_atomic_t serverStopping;
+
+/****************************************************************
+* Node of a word that ends inside a compressed edge: a prefix with
+* no count, successors or children of its own. Shared by every
+* thread, so it is read-only
+*/
+const TrieNode edgeNode;
 
 
 /****************************************************************
 * Prototypes
 */
-TrieNode* createTrieNode                  (void);
+char*     mapFile                         (char* filename, size_t* size, int advice);
+
+void*     runBuildTask                    (void* task);
+
+void*     runMergeTask                    (void* task);
+
+bool      mergeTrie                       (Trie* trie, Trie* source);
+
+bool      mergeTrieNode                   (Trie* trie, TrieNode* node, unsigned int nodeId,
+                                           Trie* source, TrieNode* sourceNode);
+
+bool      mergeSubtrieNode                (Trie* trie, TrieNode* node, unsigned int previousWord,
+                                           Trie* source, TrieNode* sourceNode);
+
+unsigned int getOrCreateWordRecord        (Trie* trie, char* word);
+
+bool      insertFile                      (Trie* trie, char* filename);
+
+bool      thawTrie                        (Trie* trie);
+
+bool      placeFrozenChildren             (Trie* trie, TrieFreezer* freezer, TrieNode* node);
+
+unsigned int getFreeFreezerSlot           (TrieFreezer* freezer, unsigned int position);
+
+bool      takeFreezerSlot                 (TrieFreezer* freezer, unsigned int position, unsigned int id);
+
+bool      reserveFreezerSlots             (TrieFreezer* freezer, size_t size);
+
+void      packSuccessorNodes              (Trie* trie, TrieNode* node, TrieSuccessor* successors,
+                                           unsigned int* numberOfSuccessors);
+
+int       compareSuccessorRanks           (const void* item, const void* other);
+
+bool      unpackTrie                      (Trie* trie);
+
+void      compressTrieNode                (Trie* trie, unsigned int id, unsigned int* labels, char* labelText,
+                                           unsigned int* labelTextLength);
+
+bool      pruneTrieNode                   (Trie* trie, unsigned int id, bool* keep, unsigned int* position);
+
+bool      hasSuccessors                   (Trie* trie, const TrieNode* node);
+
+Trie*     createTrie                      (void);
+
+bool      writePadding                    (FILE* file, long offset);
+
+TrieNode* createTrieNode                  (Trie* trie, unsigned int* id);
+
+bool      addTrieSlab                     (Trie* trie);
+
+TrieNode* getNode                         (Trie* trie, unsigned int id);
+
+TrieNode* getFirstChild                   (Trie* trie, TrieNode* node);
+
+TrieNode* getNextSibling                  (Trie* trie, TrieNode* node);
+
+unsigned int getChildId                   (Trie* trie, TrieNode* node, char letter);
+
+TrieNode* getOrCreateChild                (Trie* trie, TrieNode* node, char letter, unsigned int* id);
+
+TrieNode* splitEdge                       (Trie* trie, unsigned int* link);
+
+char*     getEdgeLabel                    (Trie* trie, unsigned int id);
+
+unsigned int addTrieWord                  (Trie* trie, unsigned int node, char* word);
+
+char*     getWordSpelling                 (Trie* trie, unsigned int word);
+
+void      updateTextPrediction            (Trie* trie, TrieWord* word, TrieNode* successor);
+
+void      printTrieSimpleFormat           (Trie* trie, TrieNode* root, TrieOutput* output);
+
+void      printTrieNodeWordsSimpleFormat  (Trie* trie, TrieNode* node, char* word, int length,
+                                           TrieOutput* output);
+
+bool      hasChildren                     (TrieNode* node);
+
+int       getNumberOfChildren             (Trie* trie, TrieNode* node);
+
+void      insertPhrase                    (Trie* trie, char* phrase);
+
+void      insertBlock                     (Trie* trie, TrieReader* reader, char* block, size_t length);
+
+void      endWord                         (Trie* trie, TrieReader* reader);
+
+bool      isLetter                        (unsigned char character, int alphabet);
+
+char      toLowercase                     (unsigned char character);
+
+unsigned int getLetterMask                (char* text, int alphabet);
+
+unsigned int getLetterMaskScalar          (char* text, int alphabet);
+
+#ifdef TRIE_SIMD
+unsigned int getLetterMaskSse2            (char* text, int alphabet);
+
+unsigned int getLetterMaskAvx2            (char* text, int alphabet);
+#endif
+
+void      copyLowercase                   (char* word, char* text, size_t length);
+
+TrieNode* insertNextWord                  (Trie* trie, TrieNode* previousWordNode, char* word,
+                                           TrieNode** contextNodes);
+
+void      insertText                      (Trie* trie, char* text, size_t length);
+
+TrieNode* endTextWord                     (Trie* trie, TrieNode* previousWordNode, TrieNode* wordNode,
+                                           unsigned int wordNodeId, TrieNode* successorNode,
+                                           char* text, size_t length, TrieNode** contextNodes);
+
+void      linkWord                        (Trie* trie, TrieNode* previousWordNode, TrieNode* wordNode,
+                                           unsigned int wordNodeId, TrieNode* successorNode, char* word,
+                                           TrieNode** contextNodes);
+
+void      linkContexts                    (Trie* trie, TrieNode* previousWordNode, TrieNode* successorNode,
+                                           unsigned int word, TrieNode** contextNodes);
+
+TrieNode* insertContextWord               (Trie* trie, TrieNode* context, unsigned int word);
+
+void      countSketchPair                 (Trie* trie, unsigned int previous, unsigned int word);
+
+unsigned int getSketchColumn              (TrieSketch* sketch, unsigned int row, unsigned long long pair);
+
+bool      growSketchCandidates            (TrieSketch* sketch, unsigned int numberOfWords);
+
+bool      packSketchCandidates            (Trie* trie);
+
+TrieNode* insertWord                      (Trie* trie, TrieNode* node, char* word, unsigned int* id);
+
+bool      hasUpdateCommands               (char* text, size_t size);
+
+void      runQueryTasks                   (Trie* trie, char* text, size_t size, TrieQueryTask* tasks,
+                                           int numberOfThreads);
+
+void*     runQueryTask                    (void* task);
+
+void      runMemoizedCommand              (Trie* trie, char* command, TrieQueryMemo* memo,
+                                           TrieOutput* output);
+
+void      stopServer                      (int signal);
+
+void*     runServerTask                   (void* task);
+
+bool      acceptConnections               (TrieServerTask* task, int poll, TrieConnection** connections);
+
+bool      serveConnection                 (TrieServerTask* task, int poll, TrieConnection* connection);
+
+bool      answerRequests                  (TrieServerTask* task, TrieConnection* connection);
+
+void      closeConnection                 (TrieConnection* connection, TrieConnection** connections);
+
+int       parsePredictionCommand          (Trie* trie, char* phrase, char* word);
+
+int       getCommandKind                  (char* command);
+
+void      writeRankedWords                (Trie* trie, TrieSuccessor* words, int numberOfWords, TrieOutput* output);
+
+void      writePackedSuccessors           (Trie* trie, unsigned int word, TrieOutput* output);
+
+int       getWordSuccessors               (Trie* trie, const TrieNode* node, int numberOfSuccessors, bool alphabetical,
+                                           TrieSuccessor* words);
+
+int       getTopWords                     (Trie* trie, unsigned int root, int numberOfWords, TrieSuccessor* words);
+
+void      getFirstWords                   (Trie* trie, unsigned int id, int numberOfWords, TrieSuccessor* words,
+                                           int* numberFound);
+
+TrieRank* getRanks                        (Trie* trie);
+
+TrieRank  fillRanks                       (Trie* trie, unsigned int id, TrieRank* ranks);
+
+void      updateRanks                     (Trie* trie, unsigned int id, unsigned int word, unsigned int count);
+
+bool      precedesCompletion              (Trie* trie, TrieCompletion* item, TrieCompletion* other);
+
+void      pushCompletion                  (Trie* trie, TrieCompletion* heap, int* heapLength, TrieCompletion item);
+
+TrieCompletion popCompletion              (Trie* trie, TrieCompletion* heap, int* heapLength);
+
+long      countTrieNodes                  (Trie* trie, TrieNode* node, long* numberOfWords);
+
+size_t    getTrieBytes                    (Trie* trie);
+
+void      recordCommandLatency            (int kind, struct timespec* start);
+
+void      writeStatsLatencies             (TrieOutput* output);
+
+void      getTextPrediction               (Trie* trie, const TrieNode* node, int counter, TrieOutput* output);
+
+void      getBeamPrediction               (Trie* trie, const TrieNode* node, int counter, TrieOutput* output);
+
+void      getSampledPrediction            (Trie* trie, const TrieNode* node, int counter, TrieOutput* output);
+
+unsigned int getContextPrediction         (Trie* trie, unsigned int* history, int historyLength);
+
+const TrieNode* getContextNode            (Trie* trie, unsigned int* history, int historyLength);
+
+int       getNextWords                    (Trie* trie, unsigned int* history, int historyLength, int numberOfWords,
+                                           TrieSuccessor* words, int* total);
+
+void      selectTopWords                  (Trie* trie, TrieNode* node, int numberOfWords, TrieSuccessor* words,
+                                           int* numberFound);
+
+bool      reserveOutput                   (TrieOutput* output, size_t length);
+
+void      writeOutput                     (TrieOutput* output, char* text, size_t length);
+
+void      writeOutputString               (TrieOutput* output, char* text);
+
+void      writeOutputNumber               (TrieOutput* output, long number);
+
+void      writeOutputFormat               (TrieOutput* output, char* format, ...);
+
+void      flushOutput                     (TrieOutput* output);
+
+bool      findQueryMemo                   (TrieQueryMemo* memo, char* key, size_t* offset, size_t* length);
+
+void      addQueryMemo                    (TrieQueryMemo* memo, char* key, size_t offset, size_t length);
+
+bool      growQueryMemo                   (TrieQueryMemo* memo);
+
+void      clearQueryMemo                  (TrieQueryMemo* memo);
+
+unsigned int hashKey                      (char* key, size_t length);
+
+void      runBenchmark                    (char* filename, char* commandFilename);
+
+void      reportBuildBenchmark            (char* name, Trie* trie, double buildSeconds, off_t size);
+
+void      runInsertBenchmark              (void);
+
+void      runTokenizeBenchmark            (char* filename);
+
+long      countBlockWords                 (char* block, size_t length, int alphabet,
+                                           unsigned int (*getMask) (char*, int));
+
+void      runLoadGenerator                (char* socketPath, char* filename, int numberOfConnections, int depth);
+
+void*     runLoadTask                     (void* task);
+
+bool      sendRequests                    (int client, TrieOutput* requests);
+
+int       compareLatencies                (const void* item, const void* other);
+
+void      runQueryBenchmark               (Trie* trie, char* filename);
+
+void      runLookupBenchmark              (Trie* trie, char* prefix);
+
+void      runUpdateBenchmark              (Trie* trie);
+
+void      runCompactBenchmark             (Trie* trie, char* filename);
+
+void      runSketchBenchmark              (char* filename);
+
+void      reportMetric                    (char* benchmark, char* metric, double value);
+
+void      generateCorpus                  (long long size, unsigned long long seed);
+
+void      getGeneratedWord                (unsigned int rank, char* word);
 
-void      destroyTrieNode                 (TrieNode* node);
+unsigned long long getNextRandom          (unsigned long long* state);
 
-void      printTrie                       (TrieNode* root);
+long long parseSize                       (char* text);
 
-void      printTrieNode                   (TrieNode* node, char* tabString);
+double    getElapsedSeconds               (struct timespec* start);
 
-void      printTrieSimpleFormat           (TrieNode* root);
+/****************************************************************
+ * Main function to start the application.
+ *
+ * @param		numberOfArguments		number of arguments used to run the application
+ * @param		arguments						array of arguments used to run the application
+ *
+ * @return	int									program exit status
+ */
+int main (int numberOfArguments, char* arguments[])
+{
+	// variables
+  Trie*     trie;                   // trie with its node pool
+  int       numberOfThreads = 0,    // number of threads of a parallel build
+            order = 2,              // n-gram order of the trie
+            minimumContextCount = 2,   // times a long context is seen before it is extended
+            alphabet = TRIE_ALPHABET_LETTERS,   // characters words are made of
+            beamWidth = 0,          // chains kept by the beam search of predictions
+            sampleSize = 0,         // successors drawn from by sampled predictions
+            depth = CLIENT_DEFAULT_DEPTH,   // requests in flight on each connection of the load generator
+            minimumWordCount = 0,   // times a word is seen to survive compaction
+            minimumSuccessorCount = 0,   // times a successor is seen to survive compaction
+            maximumSuccessors = 0,  // successors of each word kept by compaction, 0 for all
+            numberOfCandidates = SKETCH_DEFAULT_CANDIDATES;   // successors of each word kept by a sketch build
+  size_t    sketchSize = 0;         // bytes of the sketch of a sketch build, 0 for exact counts
+  double    temperature = 1;        // temperature of sampled predictions
+  unsigned long long seed = 1;      // seed of sampled predictions
+  bool      mapped = false,         // whether the corpus is mapped in memory
+            freeze = false,         // whether the trie is frozen before the queries
+            pack = false,           // whether the successors are packed before the queries
+            compress = false,       // whether the edges are compressed before the queries
+            compact = false,        // whether rare words and successors are dropped before the queries
+            load = false,           // whether the first file is a snapshot
+            batch = false;          // whether commands are answered as one batch
+  char*     snapshot = NULL;        // name of the snapshot file to be written
+  char*     update = NULL;          // name of the file with text added after the build
+  char*     server = NULL;          // path of the socket to serve queries on
+  char*     filename1;              // name of the file with the words for the trie
+  char*     filename2;              // name of the file with the commands
+  struct timespec start;            // start time of the build
+
+  // options come before the file names
+  while ((numberOfArguments > 1) && (arguments[1][0] == '-'))
+  {
+    // benchmark mode: TriePrediction -benchmark corpus.txt [commands.txt]
+    if ((strcmp(arguments[1], "-benchmark") == 0) && (numberOfArguments > 2))
+    {
+      runBenchmark(arguments[2], (numberOfArguments > 3) ? arguments[3] : NULL);
+      return 0;
+    }
+
+    // corpus generator: TriePrediction -generate 100M [seed] > corpus.txt
+    else if ((strcmp(arguments[1], "-generate") == 0) && (numberOfArguments > 2))
+    {
+      generateCorpus(parseSize(arguments[2]), (numberOfArguments > 3) ? strtoull(arguments[3], NULL, 10) : 1);
+      return 0;
+    }
+
+    // load generator: TriePrediction [-threads 8] [-depth 16] -client trie.sock commands.txt
+    else if ((strcmp(arguments[1], "-client") == 0) && (numberOfArguments > 3))
+    {
+      runLoadGenerator(arguments[2], arguments[3], (numberOfThreads > 0) ? numberOfThreads : 1, depth);
+      return 0;
+    }
+
+    else if ((strcmp(arguments[1], "-depth") == 0) && (numberOfArguments > 2))
+    {
+      depth = atoi(arguments[2]);
+      numberOfArguments--;
+      arguments++;
+    }
+
+    // query server: TriePrediction -serve trie.sock corpus.txt
+    else if ((strcmp(arguments[1], "-serve") == 0) && (numberOfArguments > 2))
+    {
+      server = arguments[2];
+      numberOfArguments--;
+      arguments++;
+    }
+
+    // memory-mapped build: TriePrediction -mmap corpus.txt commands.txt
+    else if (strcmp(arguments[1], "-mmap") == 0)
+    {
+      mapped = true;
+    }
+
+    // parallel build and queries: TriePrediction -threads 8 corpus.txt commands.txt
+    else if ((strcmp(arguments[1], "-threads") == 0) && (numberOfArguments > 2))
+    {
+      numberOfThreads = atoi(arguments[2]);
+      numberOfArguments--;
+      arguments++;
+    }
+
+    // snapshot: TriePrediction -save trie.snap corpus.txt [commands.txt]
+    else if ((strcmp(arguments[1], "-save") == 0) && (numberOfArguments > 2))
+    {
+      snapshot = arguments[2];
+      numberOfArguments--;
+      arguments++;
+    }
+
+    // snapshot instead of corpus: TriePrediction -load trie.snap commands.txt
+    else if (strcmp(arguments[1], "-load") == 0)
+    {
+      load = true;
+    }
+
+    // n-gram model: TriePrediction -order 3 [-prune 2] corpus.txt commands.txt
+    else if ((strcmp(arguments[1], "-order") == 0) && (numberOfArguments > 2))
+    {
+      order = atoi(arguments[2]);
+      numberOfArguments--;
+      arguments++;
+    }
+
+    else if ((strcmp(arguments[1], "-prune") == 0) && (numberOfArguments > 2))
+    {
+      minimumContextCount = atoi(arguments[2]);
+      numberOfArguments--;
+      arguments++;
+    }
+
+    // digits and UTF-8 characters in words: TriePrediction -alphabet bytes corpus.txt commands.txt
+    else if ((strcmp(arguments[1], "-alphabet") == 0) && (numberOfArguments > 2) &&
+             ((strcmp(arguments[2], "letters") == 0) || (strcmp(arguments[2], "bytes") == 0)))
+    {
+      alphabet = (strcmp(arguments[2], "bytes") == 0) ? TRIE_ALPHABET_BYTES : TRIE_ALPHABET_LETTERS;
+      numberOfArguments--;
+      arguments++;
+    }
+
+    // new text for the built or loaded trie: TriePrediction -load trie.snap -update new.txt commands.txt
+    else if ((strcmp(arguments[1], "-update") == 0) && (numberOfArguments > 2))
+    {
+      update = arguments[2];
+      numberOfArguments--;
+      arguments++;
+    }
+
+    // frozen layout for queries: TriePrediction -freeze corpus.txt commands.txt
+    else if (strcmp(arguments[1], "-freeze") == 0)
+    {
+      freeze = true;
+    }
+
+    // successor arrays instead of subtries: TriePrediction -pack corpus.txt commands.txt
+    else if (strcmp(arguments[1], "-pack") == 0)
+    {
+      pack = true;
+    }
+
+    // smaller model: TriePrediction -compact 2 2 8 corpus.txt commands.txt
+    else if ((strcmp(arguments[1], "-compact") == 0) && (numberOfArguments > 4))
+    {
+      compact = true;
+      minimumWordCount = atoi(arguments[2]);
+      minimumSuccessorCount = atoi(arguments[3]);
+      maximumSuccessors = atoi(arguments[4]);
+      numberOfArguments -= 3;
+      arguments += 3;
+    }
+
+    // estimated successor counts: TriePrediction -sketch 16M [-candidates 8] corpus.txt commands.txt
+    else if ((strcmp(arguments[1], "-sketch") == 0) && (numberOfArguments > 2))
+    {
+      sketchSize = parseSize(arguments[2]);
+      numberOfArguments--;
+      arguments++;
+    }
+
+    else if ((strcmp(arguments[1], "-candidates") == 0) && (numberOfArguments > 2))
+    {
+      numberOfCandidates = atoi(arguments[2]);
+      numberOfArguments--;
+      arguments++;
+    }
+
+    // multi-letter edges: TriePrediction -compress corpus.txt commands.txt
+    else if (strcmp(arguments[1], "-compress") == 0)
+    {
+      compress = true;
+    }
+
+    // prediction modes: TriePrediction -beam 4 corpus.txt commands.txt
+    else if ((strcmp(arguments[1], "-beam") == 0) && (numberOfArguments > 2))
+    {
+      beamWidth = atoi(arguments[2]);
+      numberOfArguments--;
+      arguments++;
+    }
+
+    // TriePrediction -sample 10 [-temperature 0.8] [-seed 7] corpus.txt commands.txt
+    else if ((strcmp(arguments[1], "-sample") == 0) && (numberOfArguments > 2))
+    {
+      sampleSize = atoi(arguments[2]);
+      numberOfArguments--;
+      arguments++;
+    }
+
+    else if ((strcmp(arguments[1], "-temperature") == 0) && (numberOfArguments > 2))
+    {
+      temperature = atof(arguments[2]);
+      numberOfArguments--;
+      arguments++;
+    }
+
+    else if ((strcmp(arguments[1], "-seed") == 0) && (numberOfArguments > 2))
+    {
+      seed = strtoull(arguments[2], NULL, 10);
+      numberOfArguments--;
+      arguments++;
+    }
+
+    // batch of commands: TriePrediction -batch corpus.txt commands.txt
+    else if (strcmp(arguments[1], "-batch") == 0)
+    {
+      batch = true;
+    }
+
+    else
+    {
+      printf("Unknown option %s!\n", arguments[1]);
+      return 1;
+    }
+
+    numberOfArguments--;
+    arguments++;
+  }
+
+  // consistency; the commands are optional when a snapshot is saved or queries are served
+  if ((numberOfArguments < 3) && (((snapshot == NULL) && (server == NULL)) || (numberOfArguments < 2)))
+  {
+    printf("Missing arguments!\n");
+    printf("Trie requires a text file to function properly.\n");
+    return 1;
+  }
+
+  // consistency; a sketch only counts the pairs of the streaming build of order 2
+  if ((sketchSize > 0) && (load || (order != 2) || (numberOfThreads > 0) || mapped))
+  {
+    printf("\nError: Unable to build with a sketch; -sketch builds a bigram trie "
+           "from the corpus, and cannot be combined with -load, -order above 2, -threads or -mmap.\n\n");
+    return 1;
+  }
+
+  filename1 = arguments[1];
+  filename2 = (numberOfArguments > 2) ? arguments[2] : NULL;
+
+  // creates trie from specified file
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  if (load)
+    trie = loadTrie(filename1);
+  else if (sketchSize > 0)
+    trie = buildTrieWithSketch(filename1, sketchSize, numberOfCandidates, alphabet);
+  else if (order != 2)
+    trie = buildTrieOfOrder(filename1, order, minimumContextCount, alphabet);
+  else if (numberOfThreads > 0)
+    trie = buildTrieInParallel(filename1, numberOfThreads, alphabet);
+  else if (mapped)
+    trie = buildTrieInParallel(filename1, 1, alphabet);
+  else
+    trie = buildTrieOfOrder(filename1, 2, 1, alphabet);
+
+  // consistency
+  if (trie == NULL)
+    return 1;
+
+  SET_STAT(buildSeconds, getElapsedSeconds(&start));
+
+  // adds new text without rebuilding
+  if ((update != NULL) && !updateTrieFromFile(trie, update))
+  {
+    destroyTrie(trie);
+    return 1;
+  }
+
+  // drops rare words and successors, keeping every prediction of the words kept
+  if (compact && !compactTrie(trie, minimumWordCount, minimumSuccessorCount, maximumSuccessors))
+  {
+    printf("\nError: Unable to compact the trie; only tries of order 2 can be compacted.\n\n");
+    destroyTrie(trie);
+    return 1;
+  }
+
+  // replaces the successor subtries with arrays; a packed snapshot loads packed
+  if (pack && !packTrie(trie))
+  {
+    printf("\nError: Unable to pack the trie; only tries of order 2 can be packed.\n\n");
+    destroyTrie(trie);
+    return 1;
+  }
+
+  // merges single-child chains into edges, and freezes; a compressed snapshot loads compressed
+  if (compress && !compressTrie(trie))
+  {
+    printf("\nError: Unable to compress trie.\n\n");
+    destroyTrie(trie);
+    return 1;
+  }
+
+  // lays the nodes out for lookups; a frozen snapshot loads frozen
+  if (freeze && !freezeTrie(trie))
+  {
+    destroyTrie(trie);
+    return 1;
+  }
 
-void      printTrieNodeWordsSimpleFormat  (TrieNode* node, char* word);
+  // writes snapshot for later runs; saveTrie reports why it could not
+  if ((snapshot != NULL) && !saveTrie(trie, snapshot))
+  {
+    destroyTrie(trie);
+    return 1;
+  }
+
+  setPredictionMode(trie, beamWidth, sampleSize, temperature, seed);
+
+  // answers queries on a socket until interrupted, on a thread per processor by default
+  if (server != NULL)
+    serveTrie(trie, server, (numberOfThreads > 0) ? numberOfThreads : (int) sysconf(_SC_NPROCESSORS_ONLN));
+
+  // runs command from input file
+  else if ((filename2 != NULL) && (numberOfThreads > 0))
+    runParallelCommands(trie, filename2, numberOfThreads);
+  else if ((filename2 != NULL) && batch)
+    runBatchCommands(trie, filename2);
+  else if (filename2 != NULL)
+    runFileCommands(trie, filename2);
+
+  // deallocates memory
+  destroyTrie(trie);
+
+	// indicates that the program is closing without any problem
+	return 0;
+}
+
+/****************************************************************
+ * Builds trie from a file.
+ *
+ * @param		filenname		  name of the file with words for creation of the trie
+ *
+ * @return	Trie*         new trie, owner of all its nodes
+ */
+Trie* buildTrie (char* filename)
+{
+  return buildTrieOfOrder(filename, 2, 1, TRIE_ALPHABET_LETTERS);
+}
+
+/****************************************************************
+ * Builds an n-gram trie from a file. Besides the subtrie of the
+ * words that follow each word, the node of each context of up to
+ * order - 2 words in those subtries gets a subtrie of the words
+ * that follow the whole context. A context is only extended after
+ * it was seen minimumContextCount times, which prunes the rare
+ * ones and bounds memory; its earlier occurrences are not counted.
+ *
+ * @param		filename		      name of the file with the words
+ * @param		order		          number of words of the longest context, successor included, from 2 to TRIE_MAX_ORDER
+ * @param		minimumContextCount	times a context of two or more words is seen before it is extended
+ * @param		alphabet		  characters of the words, TRIE_ALPHABET_LETTERS or TRIE_ALPHABET_BYTES
+ *
+ * @return	Trie*         new trie, owner of all its nodes
+ */
+Trie* buildTrieOfOrder (char* filename, int order, int minimumContextCount, int alphabet)
+{
+  Trie*       trie;           // trie with its node pool
+
+  // consistency
+  if ((filename == NULL) || (order < 2) || (order > TRIE_MAX_ORDER) || (alphabet < TRIE_ALPHABET_LETTERS) ||
+      (alphabet > TRIE_ALPHABET_BYTES))
+    return NULL;
+
+  // creates trie and its root
+  trie = createTrie();
+
+  // consistency
+  if (trie == NULL)
+    return NULL;
+
+  trie->order = order;
+  trie->minimumContextCount = minimumContextCount;
+  trie->alphabet = alphabet;
+
+  // inserts words of the file into trie
+  if (!insertFile(trie, filename))
+    return destroyTrie(trie);
+
+  // returns trie
+  return trie;
+}
+
+/****************************************************************
+ * Builds a bigram trie whose successor counts are estimated in
+ * fixed memory instead of being kept exact in a subtrie per word;
+ * the words and their own counts stay exact. Each pair of words is
+ * counted in a count-min sketch of SKETCH_DEPTH rows that take
+ * sketchSize bytes, with conservative updates: only the counters
+ * below the new estimate grow, which keeps the estimates closer.
+ * Each word keeps the numberOfCandidates successors with the
+ * largest estimates so far, the smallest one giving way to a
+ * larger estimate, and predicts the largest. The candidates then
+ * become the successor arrays of a packed trie, so every query
+ * works as on a packed trie, with estimated counts, and the sketch
+ * is freed.
+ *
+ * @param		filename		  name of the file with words for creation of the trie
+ * @param		sketchSize		bytes taken by the counters of the sketch
+ * @param		numberOfCandidates  successors kept for each word
+ * @param		alphabet		  TRIE_ALPHABET_LETTERS or TRIE_ALPHABET_BYTES
+ *
+ * @return	Trie*         new trie, or NULL if it could not be built
+ */
+Trie* buildTrieWithSketch (char* filename, size_t sketchSize, int numberOfCandidates, int alphabet)
+{
+  Trie*       trie;             // trie with its node pool
+  TrieSketch  sketch = {0};     // counts of the pairs of words
+  bool        built;            // whether the file was read and packed
+
+  // consistency
+  if ((filename == NULL) || (numberOfCandidates < 1) || (alphabet < TRIE_ALPHABET_LETTERS) ||
+      (alphabet > TRIE_ALPHABET_BYTES))
+    return NULL;
+
+  // the widest rows, a power of two, that fit
+  sketch.depth = SKETCH_DEPTH;
+  sketch.width = 1;
+  sketch.numberOfCandidates = numberOfCandidates;
+
+  while ((sketch.width < (1u << 30)) && (2 * (size_t) sketch.width * sketch.depth * sizeof(unsigned int) <= sketchSize))
+    sketch.width *= 2;
+
+  sketch.counters = calloc((size_t) sketch.width * sketch.depth, sizeof(unsigned int));
+  trie = createTrie();
+
+  // consistency
+  if ((sketch.counters == NULL) || (trie == NULL))
+  {
+    free(sketch.counters);
+    return destroyTrie(trie);
+  }
+
+  trie->alphabet = alphabet;
+  trie->sketch = &sketch;
+
+  // inserts words of the file into trie, and their pairs into the sketch
+  built = insertFile(trie, filename) && packSketchCandidates(trie);
+
+  trie->sketch = NULL;
+  free(sketch.counters);
+  free(sketch.candidates);
+
+  return built ? trie : destroyTrie(trie);
+}
+
+/****************************************************************
+ * Inserts the words of a file into a trie, read in large blocks
+ * so lines of any length are kept whole.
+ *
+ * @param		trie		      trie that receives the words
+ * @param		filename		  name of the file with the words
+ *
+ * @return  bool          true if the file was read; otherwise, false
+ */
+bool insertFile (Trie* trie, char* filename)
+{
+  FILE*       file;           // file with the words
+  TrieReader  reader = {0};   // state carried between blocks
+  char*       block;          // block of text read from the file
+  size_t      length;         // number of characters in the block
+
+  // opens file
+  file = fopen(filename, "r");
+
+  // consistency
+  if (file == NULL)
+  {
+    printf("\nError: Unable to open file %s.\n\n", filename);
+    return false;
+  }
+
+  block = malloc(READ_BLOCK_SIZE);
+
+  // consistency
+  if (block == NULL)
+  {
+    fclose(file);
+    return false;
+  }
+
+  while ((length = fread(block, 1, READ_BLOCK_SIZE, file)) > 0)
+  {
+    // inserts words of the block into trie
+    insertBlock(trie, &reader, block, length);
+  }
+
+  // inserts last word when the file does not end with a newline
+  endWord(trie, &reader);
+
+  // closes file
+  free(block);
+  fclose(file);
+
+  return true;
+}
+
+/****************************************************************
+ * Inserts a phrase into a trie that was already built or loaded,
+ * as if it were one more line of its corpus. The predictions and
+ * the rankings of completions and successors are updated with the
+ * counts, so later queries see the phrase without any rebuild. A
+ * loaded trie is first copied out of its snapshot, and a packed
+ * one gets its successor subtries back. The trie must not be
+ * queried by other threads meanwhile.
+ *
+ * @param		trie		      trie that receives the words
+ * @param		phrase		    string with words
+ *
+ * @return  bool          true if the phrase was inserted; otherwise, false
+ */
+bool updateTrie (Trie* trie, char* phrase)
+{
+  // consistency
+  if ((trie == NULL) || (phrase == NULL) || !thawTrie(trie) || !unpackTrie(trie))
+    return false;
+
+  insertPhrase(trie, phrase);
+
+  return true;
+}
+
+/****************************************************************
+ * Inserts the words of a file into a trie that was already built
+ * or loaded, with the same effect as building it from its corpus
+ * followed by the file. See updateTrie.
+ *
+ * @param		trie		      trie that receives the words
+ * @param		filename		  name of the file with the words
+ *
+ * @return  bool          true if the file was inserted; otherwise, false
+ */
+bool updateTrieFromFile (Trie* trie, char* filename)
+{
+  // consistency
+  if ((trie == NULL) || (filename == NULL) || !thawTrie(trie) || !unpackTrie(trie))
+    return false;
+
+  return insertFile(trie, filename);
+}
+
+/****************************************************************
+ * Builds trie from a file mapped in memory. The words are inserted
+ * straight from the mapped characters, with no intermediate copy.
+ *
+ * @param		filenname		  name of the file with words for creation of the trie
+ *
+ * @return	Trie*         new trie, owner of all its nodes
+ */
+Trie* buildTrieFromMappedFile (char* filename)
+{
+  return buildTrieInParallel(filename, 1, TRIE_ALPHABET_LETTERS);
+}
+
+/****************************************************************
+ * Builds trie from a file mapped in memory, using several threads.
+ * The file is split into chunks at line boundaries, each thread
+ * builds a private trie from one chunk, and the tries are merged
+ * pairwise, also in parallel, until one is left. The result is
+ * the same as the one of a serial build.
+ *
+ * @param		filenname		  name of the file with words for creation of the trie
+ * @param		numberOfThreads   number of chunks and threads
+ * @param		alphabet		  characters of the words, TRIE_ALPHABET_LETTERS or TRIE_ALPHABET_BYTES
+ *
+ * @return	Trie*         new trie, owner of all its nodes
+ */
+Trie* buildTrieInParallel (char* filename, int numberOfThreads, int alphabet)
+{
+  TrieBuildTask*  tasks;      // one task per chunk
+  pthread_t*      threads;    // one thread per task
+  bool*           started;    // whether each merge got its own thread
+  Trie*           trie;       // trie with all chunks
+  char*           text;       // contents of the file
+  char*           newline;    // newline that ends a chunk
+  size_t          size,       // size of the file
+                  start = 0,  // start of the current chunk
+                  end;        // end of the current chunk
+  bool            failed = false;
+
+  // consistency
+  if ((filename == NULL) || (numberOfThreads < 1) || (alphabet < TRIE_ALPHABET_LETTERS) ||
+      (alphabet > TRIE_ALPHABET_BYTES))
+    return NULL;
+
+  text = mapFile(filename, &size, MADV_SEQUENTIAL);
+
+  // an empty file cannot be mapped, and has no words
+  if (size == 0)
+  {
+    trie = createTrie();
+
+    if (trie != NULL)
+      trie->alphabet = alphabet;
+
+    return trie;
+  }
+
+  // consistency
+  if (text == NULL)
+    return NULL;
+
+  tasks = calloc(numberOfThreads, sizeof(TrieBuildTask));
+  threads = calloc(numberOfThreads, sizeof(pthread_t));
+  started = calloc(numberOfThreads, sizeof(bool));
+
+  // consistency
+  if ((tasks == NULL) || (threads == NULL) || (started == NULL))
+  {
+    free(tasks);
+    free(threads);
+    free(started);
+    munmap(text, size);
+    return NULL;
+  }
+
+  // splits file right after the first newline past each even share
+  for (int i = 0; i < numberOfThreads; i++)
+  {
+    end = size * (i + 1) / numberOfThreads;
+
+    if (end < start)
+      end = start;
+
+    newline = memchr(text + end, '\n', size - end);
+    end = ((i == numberOfThreads - 1) || (newline == NULL)) ? size : (size_t) (newline - text) + 1;
+
+    tasks[i].trie = createTrie();
+    tasks[i].text = text + start;
+    tasks[i].length = end - start;
+
+    if (tasks[i].trie == NULL)
+      failed = true;
+    else
+      tasks[i].trie->alphabet = alphabet;
+
+    start = end;
+  }
+
+  // builds one trie per chunk; the first chunk runs on this thread
+  for (int i = 1; (i < numberOfThreads) && !failed; i++)
+  {
+    started[i] = (pthread_create(&threads[i], NULL, runBuildTask, &tasks[i]) == 0);
+
+    // a chunk without a thread is built on this one
+    if (!started[i])
+      runBuildTask(&tasks[i]);
+  }
+
+  if (!failed)
+    runBuildTask(&tasks[0]);
+
+  for (int i = 1; (i < numberOfThreads) && !failed; i++)
+  {
+    if (started[i])
+      pthread_join(threads[i], NULL);
+  }
+
+  // merges tries in pairs; each round halves the number of tries
+  for (int step = 1; (step < numberOfThreads) && !failed; step *= 2)
+  {
+    for (int i = 0; i + step < numberOfThreads; i += 2 * step)
+    {
+      tasks[i].source = tasks[i + step].trie;
+      tasks[i + step].trie = NULL;
+
+      started[i] = (i > 0) && (pthread_create(&threads[i], NULL, runMergeTask, &tasks[i]) == 0);
+    }
+
+    // the first pair is merged on this thread, as well as pairs without a thread
+    for (int i = 0; i + step < numberOfThreads; i += 2 * step)
+    {
+      if (started[i])
+        pthread_join(threads[i], NULL);
+      else
+        runMergeTask(&tasks[i]);
+
+      failed = failed || tasks[i].failed;
+    }
+  }
+
+  trie = tasks[0].trie;
+
+  // releases tries of a failed build
+  if (failed)
+  {
+    for (int i = 0; i < numberOfThreads; i++)
+      destroyTrie(tasks[i].trie);
+
+    trie = NULL;
+  }
+
+  free(tasks);
+  free(threads);
+  free(started);
+  munmap(text, size);
+
+  return trie;
+}
+
+/****************************************************************
+ * Maps a whole file in memory. The kernel is told how the file will
+ * be read: MADV_SEQUENTIAL for a text read once from start to end,
+ * which is read ahead and dropped behind, or MADV_RANDOM for a
+ * snapshot queried anywhere for as long as it is mapped.
+ *
+ * @param		filename		  name of the file
+ * @param		size		      receives the size of the file
+ * @param		advice		    MADV_SEQUENTIAL or MADV_RANDOM
+ *
+ * @return	char*         contents of the file, or NULL if it is empty or cannot be mapped
+ */
+char* mapFile (char* filename, size_t* size, int advice)
+{
+  int         file;       // descriptor of the file
+  struct stat status;     // status of the file, with its size
+  char*       text;       // contents of the file
+
+  *size = 0;
+
+  // opens file
+  file = open(filename, O_RDONLY);
+
+  // consistency
+  if ((file < 0) || (fstat(file, &status) != 0))
+  {
+    printf("\nError: Unable to open file %s.\n\n", filename);
+
+    if (file >= 0)
+      close(file);
+
+    return NULL;
+  }
+
+  // an empty file cannot be mapped
+  if (status.st_size == 0)
+  {
+    close(file);
+    return NULL;
+  }
+
+  // maps file
+  text = mmap(NULL, status.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+  close(file);
+
+  // consistency
+  if (text == MAP_FAILED)
+  {
+    printf("\nError: Unable to map file %s.\n\n", filename);
+    return NULL;
+  }
+
+  madvise(text, status.st_size, advice);
+
+  *size = status.st_size;
+
+  return text;
+}
+
+/****************************************************************
+ * Thread function. Inserts the chunk of a task into its trie.
+ *
+ * @param		task		      TrieBuildTask with the chunk
+ *
+ * @return	void*         NULL
+ */
+void* runBuildTask (void* task)
+{
+  TrieBuildTask* buildTask = task;   // task with the chunk
+
+  insertText(buildTask->trie, buildTask->text, buildTask->length);
+
+  return NULL;
+}
+
+/****************************************************************
+ * Thread function. Merges the source trie of a task into its trie
+ * and destroys the source; the task records whether the merge ran
+ * out of memory.
+ *
+ * @param		task		      TrieBuildTask with both tries
+ *
+ * @return	void*         NULL
+ */
+void* runMergeTask (void* task)
+{
+  TrieBuildTask* mergeTask = task;   // task with both tries
+
+  mergeTask->failed = !mergeTrie(mergeTask->trie, mergeTask->source);
+  mergeTask->source = destroyTrie(mergeTask->source);
+
+  return NULL;
+}
+
+/****************************************************************
+ * Adds all words, counts and subtries of a trie to another one.
+ *
+ * @param		trie		      trie that receives the words
+ * @param		source		    trie with the words to be added
+ *
+ * @return  bool          true if every word was added; otherwise, false, and the trie is incomplete
+ */
+bool mergeTrie (Trie* trie, Trie* source)
+{
+  // consistency
+  if ((trie == NULL) || (source == NULL))
+    return false;
+
+  // the root id is always 0
+  return mergeTrieNode(trie, trie->root, 0, source, source->root);
+}
+
+/****************************************************************
+ * Auxiliary function. Merges a node of the main trie, with its
+ * subtrie and children.
+ *
+ * @param		trie		      trie that receives the words
+ * @param		node		      node that receives the counts
+ * @param		nodeId		    id of the node
+ * @param		source		    trie with the words to be added
+ * @param		sourceNode		node with the same string in the source
+ *
+ * @return  bool          true if the node was merged; otherwise, false, if out of memory
+ */
+bool mergeTrieNode (Trie* trie, TrieNode* node, unsigned int nodeId,
+                    Trie* source, TrieNode* sourceNode)
+{
+  TrieNode*    child;     // child of the node
+  unsigned int childId;   // id of the child
+
+  node->count += sourceNode->count;
+
+  // creates record of a new word
+  if ((sourceNode->word != 0) && (node->word == 0))
+  {
+    node->word = addTrieWord(trie, nodeId, getWordSpelling(source, sourceNode->word));
+
+    // consistency
+    if (node->word == 0)
+      return false;
+  }
+
+  // merges subtries
+  if (sourceNode->subtrie != 0)
+  {
+    // consistency
+    if ((node->subtrie == 0) && (createTrieNode(trie, &node->subtrie) == NULL))
+      return false;
+
+    if (!mergeSubtrieNode(trie, getNode(trie, node->subtrie), node->word,
+                          source, getNode(source, sourceNode->subtrie)))
+      return false;
+  }
+
+  // merges children
+  for (TrieNode* sourceChild = getFirstChild(source, sourceNode); sourceChild != NULL;
+       sourceChild = getNextSibling(source, sourceChild))
+  {
+    child = getOrCreateChild(trie, node, sourceChild->letter, &childId);
+
+    // consistency
+    if ((child == NULL) || !mergeTrieNode(trie, child, childId, source, sourceChild))
+      return false;
+  }
+
+  return true;
+}
+
+/****************************************************************
+ * Auxiliary function. Merges a node of a subtrie, with its
+ * children, and updates the prediction of the word that owns the
+ * subtrie as the counts of its successors grow.
+ *
+ * @param		trie		      trie that receives the words
+ * @param		node		      subtrie node that receives the counts
+ * @param		previousWord	id of the record of the word that owns the subtrie
+ * @param		source		    trie with the words to be added
+ * @param		sourceNode		node with the same string in the source
+ *
+ * @return  bool          true if the node was merged; otherwise, false, if out of memory
+ */
+bool mergeSubtrieNode (Trie* trie, TrieNode* node, unsigned int previousWord,
+                       Trie* source, TrieNode* sourceNode)
+{
+  TrieNode* child;   // child of the node
+
+  node->count += sourceNode->count;
+
+  // links successor to its record, which may precede the word itself in the merge
+  if ((sourceNode->count > 0) && (sourceNode->word != 0))
+  {
+    if (node->word == 0)
+      node->word = getOrCreateWordRecord(trie, getWordSpelling(source, sourceNode->word));
+
+    // consistency
+    if (node->word == 0)
+      return false;
+
+    if (previousWord != 0)
+      updateTextPrediction(trie, &trie->words[previousWord], node);
+  }
+
+  // merges children
+  for (TrieNode* sourceChild = getFirstChild(source, sourceNode); sourceChild != NULL;
+       sourceChild = getNextSibling(source, sourceChild))
+  {
+    child = getOrCreateChild(trie, node, sourceChild->letter, NULL);
+
+    // consistency
+    if ((child == NULL) || !mergeSubtrieNode(trie, child, previousWord, source, sourceChild))
+      return false;
+  }
+
+  return true;
+}
+
+/****************************************************************
+ * Gets the record of a word, creating its nodes in the main trie,
+ * with no count, and its record if they do not exist.
+ *
+ * @param		trie		      trie that owns the record
+ * @param		word		      spelling of the word
+ *
+ * @return	unsigned int  id of the record, or 0 if out of memory
+ */
+unsigned int getOrCreateWordRecord (Trie* trie, char* word)
+{
+  TrieNode*    node = trie->root;   // node of the current letter
+  unsigned int nodeId = 0;          // id of the node
+
+  for (char* letter = word; *letter != '\0'; letter++)
+  {
+    node = getOrCreateChild(trie, node, *letter, &nodeId);
+
+    // consistency
+    if (node == NULL)
+      return 0;
+  }
+
+  if (node->word == 0)
+    node->word = addTrieWord(trie, nodeId, word);
+
+  return node->word;
+}
+
+/****************************************************************
+ * Creates an empty trie with its root node.
+ *
+ * @return	Trie*         new trie
+ */
+Trie* createTrie (void)
+{
+  Trie*        trie;     // trie with its node pool
+  unsigned int rootId;   // id of the root, always 0
+
+  // allocates and initializes slab table to null
+  trie = calloc(1, sizeof(Trie));
+
+  // consistency
+  if (trie == NULL)
+    return NULL;
+
+  // bigrams only
+  trie->order = 2;
+  trie->minimumContextCount = 1;
+
+  // creates root
+  trie->root = createTrieNode(trie, &rootId);
+
+  // consistency
+  if (trie->root == NULL)
+    return destroyTrie(trie);
+
+  // reserves word record 0, the empty string, to mean none
+  if (addTrieWord(trie, rootId, "") != 0)
+    return destroyTrie(trie);
+
+  return trie;
+}
+
+/****************************************************************
+ * Creates and initializes trie node, carved from the slabs of the
+ * trie.
+ *
+ * @param		trie		      trie that owns the node
+ * @param		id		        receives the id of the new node
+ *
+ * @return	TrieNode*     new trie node
+ */
+TrieNode* createTrieNode (Trie* trie, unsigned int* id)
+{
+  TrieNode* node;   // node of the trie
+
+  // opens a new slab when the last one is full
+  if ((trie->numberOfSlabs == 0) || (trie->slabNodesUsed == TRIE_SLAB_SIZE))
+  {
+    if (!addTrieSlab(trie))
+      return NULL;
+  }
+
+  // takes next free node of the last slab, already zeroed
+  node = &trie->slabs[trie->numberOfSlabs - 1][trie->slabNodesUsed];
+  *id = ((unsigned int) (trie->numberOfSlabs - 1) << TRIE_SLAB_BITS) | trie->slabNodesUsed;
+  trie->slabNodesUsed++;
+
+  trie->numberOfNodes++;
+  COUNT_STAT(nodeAllocations, 1);
+
+  return node;
+}
+
+/****************************************************************
+ * Adds an empty slab of TRIE_SLAB_SIZE nodes to the trie pool.
+ *
+ * @param		trie		      trie that owns the slabs
+ *
+ * @return  bool          true if the slab was added; otherwise, false
+ */
+bool addTrieSlab (Trie* trie)
+{
+  TrieNode**    slabs;    // resized slab table
+  TrieNode*     slab;     // new slab
+  TrieRank*     ranks;    // resized ranking
+  unsigned int* labels;   // resized label offsets
+
+  // node ids are 32 bits wide
+  if (trie->numberOfSlabs == (1 << (32 - TRIE_SLAB_BITS)))
+    return false;
+
+  // grows slab table when it is full
+  if (trie->numberOfSlabs == trie->slabTableSize)
+  {
+    slabs = realloc(trie->slabs, 2 * (trie->slabTableSize + 1) * sizeof(TrieNode*));
+
+    // consistency
+    if (slabs == NULL)
+      return false;
+
+    trie->slabs = slabs;
+    trie->slabTableSize = 2 * (trie->slabTableSize + 1);
+  }
+
+  // the ranking, once built, covers every slab
+  if (trie->ranks != NULL)
+  {
+    ranks = realloc(trie->ranks, ((size_t) (trie->numberOfSlabs + 1) << TRIE_SLAB_BITS) * sizeof(TrieRank));
+
+    // consistency
+    if (ranks == NULL)
+      return false;
+
+    memset(ranks + ((size_t) trie->numberOfSlabs << TRIE_SLAB_BITS), 0, TRIE_SLAB_SIZE * sizeof(TrieRank));
+    trie->ranks = ranks;
+  }
+
+  // so do the label offsets of a compressed trie
+  if (trie->labels != NULL)
+  {
+    labels = realloc(trie->labels, ((size_t) (trie->numberOfSlabs + 1) << TRIE_SLAB_BITS) * sizeof(unsigned int));
+
+    // consistency
+    if (labels == NULL)
+      return false;
+
+    memset(labels + ((size_t) trie->numberOfSlabs << TRIE_SLAB_BITS), 0, TRIE_SLAB_SIZE * sizeof(unsigned int));
+    trie->labels = labels;
+  }
+
+  // allocates slab with all nodes initialized to zero
+  slab = calloc(TRIE_SLAB_SIZE, sizeof(TrieNode));
+
+  // consistency
+  if (slab == NULL)
+    return false;
+
+  trie->slabs[trie->numberOfSlabs] = slab;
+  trie->numberOfSlabs++;
+  trie->slabNodesUsed = 0;
+  COUNT_STAT(slabAllocations, 1);
+
+  return true;
+}
+
+/****************************************************************
+ * Destroys trie, releasing its nodes slab by slab.
+ *
+ * @param		trie		      trie to be deleted with all nodes
+ *
+ * @return	Trie*         NULL
+*/
+Trie* destroyTrie (Trie* trie)
+{
+  // consistency
+  if (trie == NULL)
+    return NULL;
+
+  free(trie->ranks);
+
+  // a loaded trie lives in its snapshot
+  if (trie->mapping != NULL)
+  {
+    munmap(trie->mapping, trie->mappingSize);
+    free(trie->slabs);
+    free(trie);
+
+    return NULL;
+  }
+
+  // frees slabs
+  for (int i = 0; i < trie->numberOfSlabs; i++)
+    free(trie->slabs[i]);
+
+  // frees slab table, word records, successor arrays, labels and trie
+  free(trie->slabs);
+  free(trie->words);
+  free(trie->spellings);
+  free(trie->successorOffsets);
+  free(trie->successors);
+  free(trie->successorRanking);
+  free(trie->labels);
+  free(trie->labelText);
+  free(trie);
+
+  return NULL;
+}
+
+/****************************************************************
+ * Writes trie to a snapshot file, to be loaded by loadTrie. Node
+ * ids are dense, since every slab but the last one is full, so
+ * the slabs are written one after the other and the id of a node
+ * is its index in the file.
+ *
+ * @param		trie		      trie to be saved
+ * @param		filename		  name of the snapshot file
+ *
+ * @return  bool          true if the snapshot was written; otherwise, false
+ */
+bool saveTrie (Trie* trie, char* filename)
+{
+  TrieSnapshotHeader header = {0};   // header of the snapshot
+  FILE*              file;           // snapshot file
+  long               remaining;      // nodes still to be written
+  size_t             slabNodes;      // nodes written from the current slab
+  bool               written;        // whether all writes succeeded
+
+  // consistency
+  if ((trie == NULL) || (filename == NULL))
+    return false;
+
+  // fills header; sections are 8-byte aligned
+  memcpy(header.magic, TRIE_SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = TRIE_SNAPSHOT_VERSION;
+  header.nodeSize = sizeof(TrieNode);
+  header.wordSize = sizeof(TrieWord);
+  header.slabBits = TRIE_SLAB_BITS;
+  header.order = trie->order;
+  header.minimumContextCount = trie->minimumContextCount;
+  header.numberOfNodes = trie->numberOfNodes;
+  header.numberOfWords = trie->numberOfWords;
+  header.spellingsLength = trie->spellingsLength;
+  header.frozen = trie->frozen;
+  header.alphabet = trie->alphabet;
+  header.packed = (trie->successorOffsets != NULL);
+  header.numberOfSuccessors = trie->numberOfSuccessors;
+  header.nodesOffset = sizeof(TrieSnapshotHeader);
+  header.wordsOffset = (header.nodesOffset + header.numberOfNodes * sizeof(TrieNode) + 7) & ~7ULL;
+  header.spellingsOffset = header.wordsOffset + header.numberOfWords * sizeof(TrieWord);
+  header.successorsOffset = (header.spellingsOffset + header.spellingsLength + 7) & ~7ULL;
+  header.compressed = (trie->labels != NULL);
+  header.labelTextLength = trie->labelTextLength;
+  header.labelsOffset = !header.packed ? header.successorsOffset :
+                        (header.successorsOffset + (header.numberOfWords + 1ULL) * sizeof(unsigned int) +
+                         header.numberOfSuccessors * (sizeof(TrieSuccessor) + sizeof(unsigned int)) + 7) & ~7ULL;
+
+  // opens file
+  file = fopen(filename, "wb");
+
+  // consistency
+  if (file == NULL)
+  {
+    printf("\nError: Unable to open file %s.\n\n", filename);
+    return false;
+  }
+
+  written = (fwrite(&header, sizeof(header), 1, file) == 1);
+
+  // writes nodes slab by slab, in id order
+  remaining = trie->numberOfNodes;
+
+  for (int i = 0; (i < trie->numberOfSlabs) && (remaining > 0) && written; i++)
+  {
+    slabNodes = (remaining < TRIE_SLAB_SIZE) ? remaining : TRIE_SLAB_SIZE;
+    written = (fwrite(trie->slabs[i], sizeof(TrieNode), slabNodes, file) == slabNodes);
+    remaining -= slabNodes;
+  }
+
+  // writes word records and spellings
+  written = written &&
+            writePadding(file, header.wordsOffset) &&
+            (fwrite(trie->words, sizeof(TrieWord), trie->numberOfWords, file) == trie->numberOfWords) &&
+            (fwrite(trie->spellings, 1, trie->spellingsLength, file) == trie->spellingsLength);
+
+  // writes successor offsets, entries and ranking, if packed
+  if (header.packed)
+  {
+    written = written &&
+              writePadding(file, header.successorsOffset) &&
+              (fwrite(trie->successorOffsets, sizeof(unsigned int), trie->numberOfWords + 1, file) ==
+               trie->numberOfWords + 1) &&
+              (fwrite(trie->successors, sizeof(TrieSuccessor), trie->numberOfSuccessors, file) ==
+               trie->numberOfSuccessors) &&
+              (fwrite(trie->successorRanking, sizeof(unsigned int), trie->numberOfSuccessors, file) ==
+               trie->numberOfSuccessors);
+  }
+
+  // writes label offsets and text, if compressed
+  if (header.compressed)
+  {
+    written = written &&
+              writePadding(file, header.labelsOffset) &&
+              (fwrite(trie->labels, sizeof(unsigned int), trie->numberOfNodes, file) == (size_t) trie->numberOfNodes) &&
+              (fwrite(trie->labelText, 1, trie->labelTextLength, file) == trie->labelTextLength);
+  }
+
+  // closes file
+  if ((fclose(file) != 0) || !written)
+  {
+    printf("\nError: Unable to write file %s.\n\n", filename);
+    return false;
+  }
+
+  return true;
+}
+
+/****************************************************************
+ * Auxiliary function. Pads a file with zeros up to an offset.
+ *
+ * @param		file		      file being written
+ * @param		offset		    offset the next section starts at
+ *
+ * @return  bool          true if the padding was written; otherwise, false
+ */
+bool writePadding (FILE* file, long offset)
+{
+  long position = ftell(file);   // current offset of the file
+
+  for (; (position >= 0) && (position < offset); position++)
+  {
+    if (fputc(0, file) == EOF)
+      return false;
+  }
+
+  return (position == offset);
+}
+
+/****************************************************************
+ * Loads trie from a snapshot written by saveTrie. The file is
+ * mapped and its node array becomes the slabs of the trie, so
+ * queries run on it in place. A loaded trie is only written to
+ * after thawTrie copies it out of the snapshot.
+ *
+ * @param		filename		  name of the snapshot file
+ *
+ * @return	Trie*         loaded trie, or NULL if the file is not a valid snapshot
+ */
+Trie* loadTrie (char* filename)
+{
+  Trie*               trie;       // trie backed by the snapshot
+  TrieSnapshotHeader* header;     // header of the snapshot
+  TrieNode*           nodes;      // node array of the snapshot
+  char*               mapping;    // contents of the snapshot
+  size_t              size;       // size of the snapshot
+  unsigned long long  packedSize; // size of the successor arrays, if packed
+  unsigned long long  labelsSize; // size of the labels, if compressed
+  struct stat         status;     // status of the file, if it cannot be mapped
+
+  // consistency
+  if (filename == NULL)
+    return NULL;
+
+  mapping = mapFile(filename, &size, MADV_RANDOM);
+
+  // consistency; an empty file is mapped as no file, but it is no more a snapshot than a truncated one
+  if (mapping == NULL)
+  {
+    if ((stat(filename, &status) == 0) && (status.st_size == 0))
+      printf("\nError: %s is not a valid snapshot.\n\n", filename);
+
+    return NULL;
+  }
+
+  header = (TrieSnapshotHeader*) mapping;
+  packedSize = (size < sizeof(TrieSnapshotHeader) || !header->packed) ? 0 :
+               (header->numberOfWords + 1ULL) * sizeof(unsigned int) +
+               header->numberOfSuccessors * (sizeof(TrieSuccessor) + sizeof(unsigned int));
+  labelsSize = (size < sizeof(TrieSnapshotHeader) || !header->compressed) ? 0 :
+               header->numberOfNodes * sizeof(unsigned int) + header->labelTextLength;
+
+  // rejects files of another format, layout or size
+  if ((size < sizeof(TrieSnapshotHeader)) ||
+      (memcmp(header->magic, TRIE_SNAPSHOT_MAGIC, sizeof(header->magic)) != 0) ||
+      (header->version != TRIE_SNAPSHOT_VERSION) ||
+      (header->nodeSize != sizeof(TrieNode)) ||
+      (header->wordSize != sizeof(TrieWord)) ||
+      (header->slabBits != TRIE_SLAB_BITS) ||
+      (header->order < 2) || (header->order > TRIE_MAX_ORDER) ||
+      (header->alphabet > TRIE_ALPHABET_BYTES) ||
+      (header->numberOfNodes == 0) ||
+      (header->numberOfWords == 0) ||
+      (header->nodesOffset + header->numberOfNodes * sizeof(TrieNode) > header->wordsOffset) ||
+      (header->wordsOffset + header->numberOfWords * sizeof(TrieWord) > header->spellingsOffset) ||
+      (header->spellingsOffset + header->spellingsLength > size) ||
+      (header->packed && ((header->order != 2) ||
+                          (header->spellingsOffset + header->spellingsLength > header->successorsOffset) ||
+                          (header->successorsOffset + packedSize > size) ||
+                          (((unsigned int*) (mapping + header->successorsOffset))[header->numberOfWords] !=
+                           header->numberOfSuccessors))) ||
+      (header->compressed && ((header->labelsOffset < header->spellingsOffset + header->spellingsLength) ||
+                              (header->labelsOffset < header->successorsOffset + packedSize) ||
+                              (header->labelsOffset + labelsSize > size))))
+  {
+    printf("\nError: %s is not a valid snapshot.\n\n", filename);
+    munmap(mapping, size);
+    return NULL;
+  }
+
+  trie = calloc(1, sizeof(Trie));
+
+  // consistency
+  if (trie == NULL)
+  {
+    munmap(mapping, size);
+    return NULL;
+  }
+
+  // slab table points into the node array
+  nodes = (TrieNode*) (mapping + header->nodesOffset);
+
+  trie->numberOfSlabs = (header->numberOfNodes + TRIE_SLAB_SIZE - 1) >> TRIE_SLAB_BITS;
+  trie->slabTableSize = trie->numberOfSlabs;
+  trie->slabNodesUsed = TRIE_SLAB_SIZE;
+  trie->slabs = malloc(trie->numberOfSlabs * sizeof(TrieNode*));
+  trie->mapping = mapping;
+  trie->mappingSize = size;
+
+  // consistency
+  if (trie->slabs == NULL)
+    return destroyTrie(trie);
+
+  for (int i = 0; i < trie->numberOfSlabs; i++)
+    trie->slabs[i] = nodes + ((size_t) i << TRIE_SLAB_BITS);
+
+  // records and spellings are used where they are
+  trie->root = nodes;
+  trie->numberOfNodes = header->numberOfNodes;
+  trie->words = (TrieWord*) (mapping + header->wordsOffset);
+  trie->numberOfWords = header->numberOfWords;
+  trie->wordTableSize = header->numberOfWords;
+  trie->spellings = mapping + header->spellingsOffset;
+  trie->spellingsLength = header->spellingsLength;
+  trie->spellingsSize = header->spellingsLength;
+  trie->order = header->order;
+  trie->minimumContextCount = header->minimumContextCount;
+  trie->frozen = (header->frozen != 0);
+  trie->alphabet = header->alphabet;
+
+  // successor arrays follow each other
+  if (header->packed)
+  {
+    trie->successorOffsets = (unsigned int*) (mapping + header->successorsOffset);
+    trie->successors = (TrieSuccessor*) (trie->successorOffsets + header->numberOfWords + 1);
+    trie->successorRanking = (unsigned int*) (trie->successors + header->numberOfSuccessors);
+    trie->numberOfSuccessors = header->numberOfSuccessors;
+  }
+
+  // label text follows the label offsets
+  if (header->compressed)
+  {
+    trie->labels = (unsigned int*) (mapping + header->labelsOffset);
+    trie->labelText = (char*) (trie->labels + header->numberOfNodes);
+    trie->labelTextLength = header->labelTextLength;
+  }
+
+  return trie;
+}
+
+/****************************************************************
+ * Auxiliary function. Copies a loaded trie out of its snapshot,
+ * so that it can grow like a built one, and unmaps the snapshot.
+ * Node ids are kept, so the ranking of the nodes stays valid.
+ *
+ * @param		trie		      trie to be copied
+ *
+ * @return  bool          true if the trie owns its memory; otherwise, false
+ */
+bool thawTrie (Trie* trie)
+{
+  TrieNode**     slabs;                // copies of the slabs
+  TrieWord*      words;                // copy of the word records
+  char*          spellings;            // copy of the spellings
+  unsigned int*  offsets = NULL;       // copy of the successor offsets, if packed
+  TrieSuccessor* successors = NULL;    // copy of the successor entries
+  unsigned int*  ranking = NULL;       // copy of the ranking of the entries
+  unsigned int*  labels = NULL;        // copy of the label offsets, if compressed
+  char*          labelText = NULL;     // copy of the label text
+  size_t         slabLength;           // number of nodes of each slab
+  bool           copied = true;        // whether every copy was allocated
+
+  // a built trie already owns its memory
+  if (trie->mapping == NULL)
+    return true;
+
+  slabs = calloc(trie->numberOfSlabs, sizeof(TrieNode*));
+  words = malloc(trie->numberOfWords * sizeof(TrieWord));
+  spellings = malloc(trie->spellingsLength);
+
+  if (trie->successorOffsets != NULL)
+  {
+    offsets = malloc((trie->numberOfWords + 1) * sizeof(unsigned int));
+    successors = malloc((trie->numberOfSuccessors + 1) * sizeof(TrieSuccessor));
+    ranking = malloc((trie->numberOfSuccessors + 1) * sizeof(unsigned int));
+    copied = (offsets != NULL) && (successors != NULL) && (ranking != NULL);
+  }
+
+  if (trie->labels != NULL)
+  {
+    labels = calloc((size_t) trie->numberOfSlabs << TRIE_SLAB_BITS, sizeof(unsigned int));
+    labelText = malloc(trie->labelTextLength + 1);
+    copied = copied && (labels != NULL) && (labelText != NULL);
+  }
+
+  copied = copied && (slabs != NULL) && (words != NULL) && (spellings != NULL);
+
+  // every slab but the last one is full; copies are zeroed past the last node
+  for (int i = 0; copied && (i < trie->numberOfSlabs); i++)
+  {
+    slabs[i] = calloc(TRIE_SLAB_SIZE, sizeof(TrieNode));
+    copied = (slabs[i] != NULL);
+
+    if (copied)
+    {
+      slabLength = trie->numberOfNodes - ((size_t) i << TRIE_SLAB_BITS);
+      slabLength = (slabLength < TRIE_SLAB_SIZE) ? slabLength : TRIE_SLAB_SIZE;
+      memcpy(slabs[i], trie->slabs[i], slabLength * sizeof(TrieNode));
+    }
+  }
+
+  // consistency
+  if (!copied)
+  {
+    for (int i = 0; (slabs != NULL) && (i < trie->numberOfSlabs); i++)
+      free(slabs[i]);
+
+    free(slabs);
+    free(words);
+    free(spellings);
+    free(offsets);
+    free(successors);
+    free(ranking);
+    free(labels);
+    free(labelText);
+
+    return false;
+  }
+
+  memcpy(words, trie->words, trie->numberOfWords * sizeof(TrieWord));
+  memcpy(spellings, trie->spellings, trie->spellingsLength);
+
+  if (offsets != NULL)
+  {
+    memcpy(offsets, trie->successorOffsets, (trie->numberOfWords + 1) * sizeof(unsigned int));
+    memcpy(successors, trie->successors, trie->numberOfSuccessors * sizeof(TrieSuccessor));
+    memcpy(ranking, trie->successorRanking, trie->numberOfSuccessors * sizeof(unsigned int));
+  }
+
+  if (labels != NULL)
+  {
+    memcpy(labels, trie->labels, trie->numberOfNodes * sizeof(unsigned int));
+    memcpy(labelText, trie->labelText, trie->labelTextLength);
+  }
+
+  // the copies replace the snapshot
+  munmap(trie->mapping, trie->mappingSize);
+  free(trie->slabs);
+
+  trie->slabs = slabs;
+  trie->root = slabs[0];
+  trie->slabNodesUsed = trie->numberOfNodes - ((unsigned int) (trie->numberOfSlabs - 1) << TRIE_SLAB_BITS);
+  trie->words = words;
+  trie->spellings = spellings;
+  trie->successorOffsets = offsets;
+  trie->successors = successors;
+  trie->successorRanking = ranking;
+  trie->labels = labels;
+  trie->labelText = labelText;
+  trie->mapping = NULL;
+  trie->mappingSize = 0;
+
+  return true;
+}
+
+/****************************************************************
+ * Freezes a trie for queries: its nodes, and those of every
+ * subtrie, are moved so that the children of each node sit at a
+ * fixed distance from its first child, given by their letters, as
+ * in a double-array trie. Finding a child then takes one probe
+ * instead of a walk along its siblings. The first and next sibling
+ * links are kept, so every other function works unchanged. Each
+ * node with children gets a base, the position its first child
+ * would have if it were an 'a' (or any letter 0), and no two nodes
+ * share a base, so a node found at the expected position with the
+ * expected letter can only be the child sought. Node ids change,
+ * and the positions no child could use are left as free slots.
+ * Inserting a new node later unfreezes the trie.
+ *
+ * @param		trie		      trie to be frozen
+ *
+ * @return  bool          true if the trie is frozen; otherwise, false
+ */
+bool freezeTrie (Trie* trie)
+{
+  TrieFreezer    freezer = {0};   // positions taken so far
+  unsigned int*  roots;            // roots of the tries, main trie first
+  unsigned char* levels;           // depth of each trie: 0 for main, 1 for successors, 2 or more for contexts
+  unsigned int*  queue;            // nodes of the current trie, in breadth-first order
+  unsigned int   numberOfRoots = 1,   // number of tries found so far
+                 queueStart,          // next node of the queue
+                 queueEnd;            // end of the queue
+  TrieNode**     slabs;            // slabs of the frozen nodes
+  TrieNode*      node;             // node being moved
+  TrieNode*      moved;            // its frozen copy
+  unsigned int*  labels = NULL;    // label offsets by new id, if compressed
+  unsigned int   id;               // new id of a node
+  int            numberOfSlabs;    // number of slabs of the frozen nodes
+  bool           frozen;           // whether every allocation succeeded
+
+  // consistency; a loaded trie is copied out of its snapshot first
+  if ((trie == NULL) || !thawTrie(trie))
+    return false;
+
+  if (trie->frozen)
+    return true;
+
+  freezer.positions = malloc(trie->numberOfNodes * sizeof(unsigned int));
+  roots = malloc(trie->numberOfNodes * sizeof(unsigned int));
+  levels = malloc(trie->numberOfNodes);
+  queue = malloc(trie->numberOfNodes * sizeof(unsigned int));
+  frozen = (freezer.positions != NULL) && (roots != NULL) && (levels != NULL) && (queue != NULL);
+
+  // nodes no trie reaches, if any, are dropped
+  if (frozen)
+    memset(freezer.positions, 0xff, trie->numberOfNodes * sizeof(unsigned int));
+
+  // places each trie after the previous one, breadth first, so lookups in one trie stay close
+  roots[0] = 0;
+  levels[0] = 0;
+
+  for (unsigned int i = 0; frozen && (i < numberOfRoots); i++)
+  {
+    frozen = takeFreezerSlot(&freezer, getFreeFreezerSlot(&freezer, 0), roots[i]);
+    queue[0] = roots[i];
+    queueStart = 0;
+    queueEnd = 1;
+
+    while (frozen && (queueStart < queueEnd))
+    {
+      node = getNode(trie, queue[queueStart++]);
+
+      if (node->subtrie != 0)
+      {
+        roots[numberOfRoots] = node->subtrie;
+        levels[numberOfRoots] = levels[i] + 1;
+        numberOfRoots++;
+      }
+
+      if (node->child == 0)
+        continue;
+
+      frozen = placeFrozenChildren(trie, &freezer, node);
+
+      for (unsigned int child = node->child; frozen && (child != 0); child = getNode(trie, child)->sibling)
+        queue[queueEnd++] = child;
+    }
+  }
+
+  free(queue);
+
+  // copies each node to its position, with its links translated
+  numberOfSlabs = (freezer.numberOfSlots + TRIE_SLAB_SIZE - 1) >> TRIE_SLAB_BITS;
+  slabs = frozen ? calloc(numberOfSlabs, sizeof(TrieNode*)) : NULL;
+  frozen = (slabs != NULL);
+
+  for (int i = 0; frozen && (i < numberOfSlabs); i++)
+  {
+    slabs[i] = calloc(TRIE_SLAB_SIZE, sizeof(TrieNode));
+    frozen = (slabs[i] != NULL);
+  }
+
+  if (frozen && (trie->labels != NULL))
+  {
+    labels = calloc((size_t) numberOfSlabs << TRIE_SLAB_BITS, sizeof(unsigned int));
+    frozen = (labels != NULL);
+  }
+
+  // consistency
+  if (!frozen)
+  {
+    for (int i = 0; (slabs != NULL) && (i < numberOfSlabs); i++)
+      free(slabs[i]);
+
+    free(slabs);
+    free(labels);
+    free(roots);
+    free(levels);
+    free(freezer.positions);
+    free(freezer.slots);
+    free(freezer.bases);
+    free(freezer.next);
+    free(freezer.failures);
+
+    return false;
+  }
+
+  for (unsigned int i = 0; i < trie->numberOfNodes; i++)
+  {
+    node = getNode(trie, i);
+    id = freezer.positions[i];
+
+    if (id == UINT_MAX)
+      continue;
+    moved = &slabs[id >> TRIE_SLAB_BITS][id & (TRIE_SLAB_SIZE - 1)];
+
+    *moved = *node;
+    moved->child = freezer.positions[node->child];
+    moved->sibling = freezer.positions[node->sibling];
+    moved->subtrie = freezer.positions[node->subtrie];
+
+    // the letters of a compressed edge follow its node
+    if (node->labelLength > 0)
+      labels[id] = trie->labels[i];
+  }
+
+  // the root of a context subtrie keeps the node id of its best successor
+  for (unsigned int i = 0; i < numberOfRoots; i++)
+  {
+    if (levels[i] < 2)
+      continue;
+
+    id = freezer.positions[roots[i]];
+    moved = &slabs[id >> TRIE_SLAB_BITS][id & (TRIE_SLAB_SIZE - 1)];
+    moved->word = freezer.positions[moved->word];
+  }
+
+  for (unsigned int i = 0; i < trie->numberOfWords; i++)
+    trie->words[i].node = freezer.positions[trie->words[i].node];
+
+  // the frozen slabs replace the old ones, and the ranking by id is rebuilt on demand
+  for (int i = 0; i < trie->numberOfSlabs; i++)
+    free(trie->slabs[i]);
+
+  free(trie->slabs);
+  free(trie->ranks);
+  free(trie->labels);
+
+  trie->slabs = slabs;
+  trie->numberOfSlabs = numberOfSlabs;
+  trie->slabTableSize = numberOfSlabs;
+  trie->slabNodesUsed = freezer.numberOfSlots - ((unsigned int) (numberOfSlabs - 1) << TRIE_SLAB_BITS);
+  trie->numberOfNodes = freezer.numberOfSlots;
+  trie->root = slabs[0];
+  trie->ranks = NULL;
+  trie->labels = labels;
+  trie->frozen = true;
+
+  free(roots);
+  free(levels);
+  free(freezer.positions);
+  free(freezer.slots);
+  free(freezer.bases);
+  free(freezer.next);
+  free(freezer.failures);
+
+  return true;
+}
+
+/****************************************************************
+ * Auxiliary function. Places the children of a node: finds the
+ * first position from which every child, at the distance of its
+ * letter from the first letter, falls on a free slot, and whose
+ * base no other node has taken. A free slot that fails as first
+ * position too many times is no longer tried, and may stay empty.
+ *
+ * @param		trie		      trie being frozen
+ * @param		freezer		    positions taken so far
+ * @param		node		      node whose children are placed
+ *
+ * @return  bool          true if the children were placed; otherwise, false
+ */
+bool placeFrozenChildren (Trie* trie, TrieFreezer* freezer, TrieNode* node)
+{
+  unsigned char first = getNode(trie, node->child)->letter;   // letter of the first child
+  unsigned int  position;                                     // candidate position of the first child
+  unsigned int  child;                                        // id of a child
+  bool          fits;                                         // whether every child fits
+
+  for (position = getFreeFreezerSlot(freezer, 0); ; position = getFreeFreezerSlot(freezer, position + 1))
+  {
+    // consistency
+    if (!reserveFreezerSlots(freezer, (size_t) position + 256))
+      return false;
+
+    fits = !freezer->bases[position + 256 - first];
+
+    for (child = node->child; fits && (child != 0); child = getNode(trie, child)->sibling)
+      fits = !freezer->slots[position + (unsigned char) getNode(trie, child)->letter - first];
+
+    if (fits)
+      break;
+
+    if (++freezer->failures[position] == FREEZE_MAX_FAILURES)
+      freezer->next[position] = position + 1;
+  }
+
+  freezer->bases[position + 256 - first] = true;
+
+  for (child = node->child; child != 0; child = getNode(trie, child)->sibling)
+    takeFreezerSlot(freezer, position + (unsigned char) getNode(trie, child)->letter - first, child);
+
+  return true;
+}
+
+/****************************************************************
+ * Auxiliary function. Finds the first slot worth trying at or
+ * after a position. Each slot links to the next one worth trying,
+ * itself if it is, and the links are shortened as they are
+ * followed, so taken slots are skipped in about constant time.
+ *
+ * @param		freezer		    positions taken so far
+ * @param		position		  position the search starts from
+ *
+ * @return  unsigned int  first free slot worth trying
+ */
+unsigned int getFreeFreezerSlot (TrieFreezer* freezer, unsigned int position)
+{
+  unsigned int slot = position,   // slot being followed
+               next;              // slot it links to
+
+  while ((slot < freezer->size) && (freezer->next[slot] != slot))
+    slot = freezer->next[slot];
+
+  // points every slot of the path straight at the result
+  while ((position < freezer->size) && (freezer->next[position] != position))
+  {
+    next = freezer->next[position];
+    freezer->next[position] = slot;
+    position = next;
+  }
+
+  return slot;
+}
+
+/****************************************************************
+ * Auxiliary function. Gives a slot to a node.
+ *
+ * @param		freezer		    positions taken so far
+ * @param		position		  free slot
+ * @param		id		        id of the node before freezing
+ *
+ * @return  bool          true if the slot was taken; otherwise, false
+ */
+bool takeFreezerSlot (TrieFreezer* freezer, unsigned int position, unsigned int id)
+{
+  // consistency
+  if (!reserveFreezerSlots(freezer, (size_t) position + 1))
+    return false;
+
+  freezer->slots[position] = true;
+  freezer->next[position] = position + 1;
+  freezer->positions[id] = position;
+
+  if (position >= freezer->numberOfSlots)
+    freezer->numberOfSlots = position + 1;
+
+  return true;
+}
+
+/****************************************************************
+ * Auxiliary function. Grows the maps of a freezer so that they
+ * hold a number of positions. The base map is indexed by position
+ * plus 256, as a base can be up to 255 below its first child.
+ *
+ * @param		freezer		    positions taken so far
+ * @param		size		      number of positions needed
+ *
+ * @return  bool          true if the maps are large enough; otherwise, false
+ */
+bool reserveFreezerSlots (TrieFreezer* freezer, size_t size)
+{
+  bool*          slots;      // resized slot map
+  bool*          bases;      // resized base map
+  unsigned int*  next;       // resized links
+  unsigned char* failures;   // resized failure counts
+  size_t         newSize;    // new number of positions
+
+  if (size <= freezer->size)
+    return true;
+
+  newSize = 2 * size + TRIE_SLAB_SIZE;
+
+  // each map is kept as soon as it is resized, so a failure leaks nothing
+  if ((slots = realloc(freezer->slots, newSize)) != NULL)
+    freezer->slots = slots;
+
+  if ((bases = realloc(freezer->bases, newSize + 256)) != NULL)
+    freezer->bases = bases;
+
+  if ((next = realloc(freezer->next, newSize * sizeof(unsigned int))) != NULL)
+    freezer->next = next;
+
+  if ((failures = realloc(freezer->failures, newSize)) != NULL)
+    freezer->failures = failures;
+
+  // consistency
+  if ((slots == NULL) || (bases == NULL) || (next == NULL) || (failures == NULL))
+    return false;
+
+  memset(slots + freezer->size, 0, newSize - freezer->size);
+  memset(bases + freezer->size + ((freezer->size > 0) ? 256 : 0), 0,
+         newSize + 256 - freezer->size - ((freezer->size > 0) ? 256 : 0));
+  memset(failures + freezer->size, 0, newSize - freezer->size);
+
+  for (size_t i = freezer->size; i < newSize; i++)
+    next[i] = i;
+
+  freezer->size = newSize;
+
+  return true;
+}
+
+/****************************************************************
+ * Packs the successors of every word into arrays, in a trie of
+ * order 2. A successor subtrie spells every following word again,
+ * one node per letter, while its entry in the arrays is the id of
+ * the word and its count. The entries of all words are stored back
+ * to back, in alphabetical order, with the offset of the first one
+ * of each word, as the rows of a compressed sparse matrix, and a
+ * second array lists them by count for the ranked queries. The
+ * subtries are then left out by laying the trie out again with
+ * freezeTrie, which drops the nodes no trie reaches. Predictions
+ * are word ids already and stay as they are. Updates unpack the
+ * trie first.
+ *
+ * @param		trie		      trie to be packed
+ *
+ * @return  bool          true if the trie is packed; otherwise, false
+ */
+bool packTrie (Trie* trie)
+{
+  unsigned int*  offsets;                    // first entry of each word
+  TrieSuccessor* successors;                 // entries of all words
+  unsigned int*  ranking;                    // entries by count
+  TrieSuccessor* ranks;                      // count and position of the entries of one word
+  TrieNode*      node;                       // node of a word
+  long           numberOfSuccessors = 0,     // entries of all words
+                 maxSuccessors = 0,          // entries of the word with the most
+                 successorsOfWord;           // entries of one word
+  unsigned int   numberPacked = 0,           // entries packed so far
+                 first;                      // first entry of the current word
+
+  // consistency; contexts of higher orders hang off the successor nodes
+  if ((trie == NULL) || (trie->order != 2) || !thawTrie(trie))
+    return false;
+
+  if (trie->successorOffsets != NULL)
+    return true;
+
+  // counts the entries of each word
+  for (unsigned int i = 1; i < trie->numberOfWords; i++)
+  {
+    node = getNode(trie, trie->words[i].node);
+    successorsOfWord = 0;
+
+    if (node->subtrie != 0)
+      countTrieNodes(trie, getNode(trie, node->subtrie), &successorsOfWord);
+
+    numberOfSuccessors += successorsOfWord;
+
+    if (successorsOfWord > maxSuccessors)
+      maxSuccessors = successorsOfWord;
+  }
+
+  // consistency; entries are indexed by 32 bits
+  if (numberOfSuccessors >= UINT_MAX)
+    return false;
+
+  offsets = malloc((trie->numberOfWords + 1) * sizeof(unsigned int));
+  successors = malloc((numberOfSuccessors + 1) * sizeof(TrieSuccessor));
+  ranking = malloc((numberOfSuccessors + 1) * sizeof(unsigned int));
+  ranks = malloc((maxSuccessors + 1) * sizeof(TrieSuccessor));
+
+  // consistency
+  if ((offsets == NULL) || (successors == NULL) || (ranking == NULL) || (ranks == NULL))
+  {
+    free(offsets);
+    free(successors);
+    free(ranking);
+    free(ranks);
+
+    return false;
+  }
+
+  offsets[0] = 0;
+
+  for (unsigned int i = 0; i < trie->numberOfWords; i++)
+  {
+    node = getNode(trie, trie->words[i].node);
+    first = numberPacked;
+
+    // the root of the main trie, record 0, has no subtrie
+    if (node->subtrie != 0)
+      packSuccessorNodes(trie, getNode(trie, node->subtrie), successors, &numberPacked);
+
+    offsets[i + 1] = numberPacked;
+
+    // ranks the entries by count; equal counts stay in alphabetical order
+    for (unsigned int j = first; j < numberPacked; j++)
+    {
+      ranks[j - first].word = j;
+      ranks[j - first].count = successors[j].count;
+    }
+
+    qsort(ranks, numberPacked - first, sizeof(TrieSuccessor), compareSuccessorRanks);
+
+    for (unsigned int j = first; j < numberPacked; j++)
+      ranking[j] = ranks[j - first].word;
+
+    // a subtrie without words, left by a word only ever followed by one without letters, stays
+    // linked, so the word still has successors as it had before packing; see hasSuccessors
+    if (numberPacked > first)
+      node->subtrie = 0;
+  }
+
+  free(ranks);
+
+  trie->successorOffsets = offsets;
+  trie->successors = successors;
+  trie->successorRanking = ranking;
+  trie->numberOfSuccessors = numberPacked;
+
+  // drops the subtries; without memory to lay the trie out, they only stay allocated
+  trie->frozen = false;
+  freezeTrie(trie);
+
+  return true;
+}
+
+/****************************************************************
+ * Auxiliary function. Appends the words of a successor subtrie
+ * to the successor arrays, in alphabetical order.
+ *
+ * @param		trie		      trie being packed
+ * @param		node		      node of the subtrie below which words are appended
+ * @param		successors		entries of all words
+ * @param		numberOfSuccessors  number of entries so far, incremented
+ */
+void packSuccessorNodes (Trie* trie, TrieNode* node, TrieSuccessor* successors, unsigned int* numberOfSuccessors)
+{
+  if ((node->count > 0) && (node->word != 0))
+  {
+    successors[*numberOfSuccessors].word = node->word;
+    successors[*numberOfSuccessors].count = node->count;
+    (*numberOfSuccessors)++;
+  }
+
+  for (TrieNode* child = getFirstChild(trie, node); child != NULL; child = getNextSibling(trie, child))
+    packSuccessorNodes(trie, child, successors, numberOfSuccessors);
+}
+
+/****************************************************************
+ * Auxiliary function. Compares two successor entries for qsort,
+ * by count, the largest first, then by position, which is
+ * alphabetical. The word of each item holds its position.
+ *
+ * @param		item		      first entry
+ * @param		other		      second entry
+ *
+ * @return  int           negative if the first entry comes first; otherwise, positive
+ */
+int compareSuccessorRanks (const void* item, const void* other)
+{
+  const TrieSuccessor* first = item;     // first entry
+  const TrieSuccessor* second = other;   // second entry
+
+  if (first->count != second->count)
+    return (first->count > second->count) ? -1 : 1;
+
+  return (first->word < second->word) ? -1 : 1;
+}
+
+/****************************************************************
+ * Auxiliary function. Turns the successor arrays of a packed trie
+ * back into subtries, so that it can be updated, and frees them.
+ * Words whose subtrie was already rebuilt are skipped, so a call
+ * that failed for lack of memory can be repeated.
+ *
+ * @param		trie		      trie to be unpacked, copied out of its snapshot
+ *
+ * @return  bool          true if the trie has subtries; otherwise, false
+ */
+bool unpackTrie (Trie* trie)
+{
+  TrieNode*    node;        // node of a word
+  TrieNode*    root;        // root of its subtrie
+  TrieNode*    successor;   // node of a successor in the subtrie
+  unsigned int rootId;      // id of the root
+
+  if (trie->successorOffsets == NULL)
+    return true;
+
+  for (unsigned int i = 1; i < trie->numberOfWords; i++)
+  {
+    if ((trie->successorOffsets[i] == trie->successorOffsets[i + 1]) ||
+        (getNode(trie, trie->words[i].node)->subtrie != 0))
+      continue;
+
+    root = createTrieNode(trie, &rootId);
+
+    // consistency
+    if (root == NULL)
+      return false;
+
+    for (unsigned int j = trie->successorOffsets[i]; j < trie->successorOffsets[i + 1]; j++)
+    {
+      successor = insertWord(trie, root, getWordSpelling(trie, trie->successors[j].word), NULL);
+
+      // consistency
+      if (successor == NULL)
+        return false;
+
+      successor->count = trie->successors[j].count;
+      successor->word = trie->successors[j].word;
+    }
+
+    // the subtrie is only linked once complete
+    node = getNode(trie, trie->words[i].node);
+    node->subtrie = rootId;
+  }
+
+  free(trie->successorOffsets);
+  free(trie->successors);
+  free(trie->successorRanking);
+
+  // the ranking by id does not cover the new subtries
+  free(trie->ranks);
+
+  trie->successorOffsets = NULL;
+  trie->successors = NULL;
+  trie->successorRanking = NULL;
+  trie->numberOfSuccessors = 0;
+  trie->ranks = NULL;
+
+  return true;
+}
+
+/****************************************************************
+ * Compresses the paths of a trie, as in a radix tree: every chain
+ * of nodes with a single child and no count, word or subtrie of
+ * their own, in the main trie and in every subtrie, becomes one
+ * edge of several letters. The last node of the chain stays, with
+ * the first letter of the edge as its letter and the others in the
+ * labels text; the nodes above it are dropped, and the trie is then
+ * frozen, which reclaims them. Nodes that end words keep their ids
+ * up to the freeze, so word records, predictions and contexts stay
+ * valid. A lookup compares the letters of an edge one after the
+ * other instead of finding a child for each. Inserting into a
+ * compressed edge splits it letter by letter; compressing again
+ * merges the pieces back.
+ *
+ * @param		trie		      trie to be compressed
+ *
+ * @return  bool          true if the trie is compressed; otherwise, false
+ */
+bool compressTrie (Trie* trie)
+{
+  unsigned int* labels;          // label offsets of the compressed edges, by node id
+  char*         labelText;       // letters of the compressed edges
+  unsigned int  labelTextLength = 0;   // number of those letters
+
+  // consistency; a loaded trie is copied out of its snapshot first
+  if ((trie == NULL) || !thawTrie(trie))
+    return false;
+
+  // each dropped node adds one letter to an edge, and the edges keep theirs
+  labels = calloc((size_t) trie->numberOfSlabs << TRIE_SLAB_BITS, sizeof(unsigned int));
+  labelText = malloc(trie->numberOfNodes + trie->labelTextLength + 1);
+
+  // consistency
+  if ((labels == NULL) || (labelText == NULL))
+  {
+    free(labels);
+    free(labelText);
+
+    return false;
+  }
+
+  compressTrieNode(trie, 0, labels, labelText, &labelTextLength);
+
+  // the new labels replace the old ones, which the edges were read from
+  free(trie->labels);
+  free(trie->labelText);
+
+  trie->labels = labels;
+  trie->labelText = labelText;
+  trie->labelTextLength = labelTextLength;
+
+  // lays out the nodes left, without the dropped ones
+  trie->frozen = false;
+
+  return freezeTrie(trie);
+}
+
+/****************************************************************
+ * Auxiliary function. Compresses the chains below each child of a
+ * node, then those below the child and in its subtrie; see
+ * compressTrie. A dropped node is unlinked from the trie, and an
+ * edge never gets more letters than its length can count.
+ *
+ * @param		trie		      trie being compressed
+ * @param		id		        id of the node
+ * @param		labels		    receives the label offset of each compressed edge
+ * @param		labelText		  receives the letters of the compressed edges
+ * @param		labelTextLength  number of those letters so far
+ */
+void compressTrieNode (Trie* trie, unsigned int id, unsigned int* labels, char* labelText,
+                       unsigned int* labelTextLength)
+{
+  TrieNode*     node = getNode(trie, id);   // node whose children are compressed
+  TrieNode*     edge;                        // last node of the chain below a child
+  TrieNode*     next;                        // only child of that node
+  unsigned int* link;                        // link to the child
+  unsigned int  edgeId;                      // id of the last node of the chain
+  unsigned int  sibling;                     // next sibling of the child
+  unsigned int  start;                       // offset of the letters of the edge
+  char          letter;                      // first letter of the edge
+
+  if (node->subtrie != 0)
+    compressTrieNode(trie, node->subtrie, labels, labelText, labelTextLength);
+
+  for (link = &node->child; *link != 0; link = &getNode(trie, *link)->sibling)
+  {
+    edgeId = *link;
+    edge = getNode(trie, edgeId);
+    letter = edge->letter;
+    sibling = edge->sibling;
+    start = *labelTextLength;
+
+    // the child keeps the letters of its edge
+    memcpy(labelText + *labelTextLength, getEdgeLabel(trie, edgeId), edge->labelLength);
+    *labelTextLength += edge->labelLength;
+
+    // follows the chain while its nodes are only a step towards the next one
+    while ((edge->count == 0) && (edge->word == 0) && (edge->subtrie == 0) && (edge->child != 0) &&
+           ((next = getNode(trie, edge->child))->sibling == 0) &&
+           (*labelTextLength - start + 1 + next->labelLength <= UCHAR_MAX))
+    {
+      labelText[(*labelTextLength)++] = next->letter;
+      memcpy(labelText + *labelTextLength, getEdgeLabel(trie, edge->child), next->labelLength);
+      *labelTextLength += next->labelLength;
+
+      // the node is dropped
+      edgeId = edge->child;
+      edge->child = 0;
+      edge = next;
+    }
+
+    // the last node of the chain takes the place of the child
+    edge->letter = letter;
+    edge->sibling = sibling;
+    edge->labelLength = *labelTextLength - start;
+    labels[edgeId] = start;
+    *link = edgeId;
+
+    compressTrieNode(trie, edgeId, labels, labelText, labelTextLength);
+  }
+}
+
+/****************************************************************
+ * Compacts a built trie of order 2 for queries, trading the rare
+ * words and successors for memory. Words seen fewer than
+ * minimumWordCount times are dropped with their subtries, unless
+ * they are predicted from a word that is kept. In the subtrie of
+ * each word kept, its most frequent successor stays, and so do the
+ * next ones, by count, that are words kept and were seen at least
+ * minimumSuccessorCount times, up to maximumSuccessors successors
+ * (0 for no limit). The nodes left without a word below them are
+ * unlinked, the word records and spellings are renumbered without
+ * the words dropped, and the trie is then frozen, or packed again
+ * if it was, which reclaims the nodes. The prediction of every word
+ * kept, and so its chain of '@', stays the same; the successor
+ * listings only lose their tails.
+ *
+ * @param		trie		      trie to be compacted
+ * @param		minimumWordCount		  times a word must be seen to be kept
+ * @param		minimumSuccessorCount	times a word must follow another to stay its successor
+ * @param		maximumSuccessors		  successors kept for each word, or 0 for all of them
+ *
+ * @return  bool          true if the trie was compacted; otherwise, false
+ */
+bool compactTrie (Trie* trie, int minimumWordCount, int minimumSuccessorCount, int maximumSuccessors)
+{
+  bool*          keepWords;               // whether each word is kept
+  bool*          keepSuccessors;          // whether each successor of a word is kept, in alphabetical order
+  unsigned int*  newIds;                  // new id of each word kept
+  TrieSuccessor* successors;              // successors of a word, in alphabetical order
+  TrieSuccessor* ranks;                   // count and position of each of them
+  char*          spellings;               // spellings of the words kept
+  TrieNode*      node;                    // node of a word
+  TrieWord*      words;                   // shrunk word table
+  long           maxSuccessors = 0,       // successors of the word with the most
+                 successorsOfWord;        // successors of one word
+  unsigned int   numberOfSuccessors,      // successors of the current word
+                 position,                // successors of the current word visited so far
+                 numberKept,              // successors of the current word kept so far
+                 numberOfWords = 0,       // words kept so far
+                 spellingsLength = 0,     // characters of their spellings
+                 word;                    // id of a word
+  bool           packed,                  // whether the successors were packed
+                 compacted;               // whether every allocation succeeded
+
+  // consistency; contexts of higher orders hang off the successor nodes
+  if ((trie == NULL) || (trie->order != 2) || !thawTrie(trie))
+    return false;
+
+  // successors are pruned in their subtries, and packed again afterwards
+  packed = (trie->successorOffsets != NULL);
+
+  if (!unpackTrie(trie))
+    return false;
+
+  for (unsigned int i = 1; i < trie->numberOfWords; i++)
+  {
+    node = getNode(trie, trie->words[i].node);
+    successorsOfWord = 0;
+
+    if (node->subtrie != 0)
+      countTrieNodes(trie, getNode(trie, node->subtrie), &successorsOfWord);
+
+    if (successorsOfWord > maxSuccessors)
+      maxSuccessors = successorsOfWord;
+  }
+
+  keepWords = calloc(trie->numberOfWords, sizeof(bool));
+  keepSuccessors = malloc((maxSuccessors + 1) * sizeof(bool));
+  newIds = calloc(trie->numberOfWords, sizeof(unsigned int));
+  successors = malloc((maxSuccessors + 1) * sizeof(TrieSuccessor));
+  ranks = malloc((maxSuccessors + 1) * sizeof(TrieSuccessor));
+  spellings = malloc(trie->spellingsLength);
+  compacted = (keepWords != NULL) && (keepSuccessors != NULL) && (newIds != NULL) &&
+              (successors != NULL) && (ranks != NULL) && (spellings != NULL);
+
+  // consistency
+  if (!compacted)
+  {
+    free(keepWords);
+    free(keepSuccessors);
+    free(newIds);
+    free(successors);
+    free(ranks);
+    free(spellings);
+
+    return false;
+  }
+
+  // words seen often enough, and record 0, the empty word
+  keepWords[0] = true;
+
+  for (unsigned int i = 1; i < trie->numberOfWords; i++)
+    keepWords[i] = (getNode(trie, trie->words[i].node)->count >= minimumWordCount);
+
+  // the predictions of the words kept are kept, and theirs, so no chain of predictions breaks
+  for (unsigned int i = 1; i < trie->numberOfWords; i++)
+  {
+    for (word = keepWords[i] ? trie->words[i].prediction : 0; (word != 0) && !keepWords[word];
+         word = trie->words[word].prediction)
+      keepWords[word] = true;
+  }
+
+  for (unsigned int i = 1; i < trie->numberOfWords; i++)
+  {
+    node = getNode(trie, trie->words[i].node);
+
+    // a word dropped is no longer a word of the main trie
+    if (!keepWords[i])
+    {
+      node->count = 0;
+      node->word = 0;
+      node->subtrie = 0;
+
+      continue;
+    }
+
+    if (node->subtrie == 0)
+      continue;
+
+    // ranks the successors by count; equal counts stay in alphabetical order
+    numberOfSuccessors = 0;
+    packSuccessorNodes(trie, getNode(trie, node->subtrie), successors, &numberOfSuccessors);
+
+    for (unsigned int j = 0; j < numberOfSuccessors; j++)
+    {
+      ranks[j].word = j;
+      ranks[j].count = successors[j].count;
+    }
+
+    qsort(ranks, numberOfSuccessors, sizeof(TrieSuccessor), compareSuccessorRanks);
+
+    // the prediction always stays, then the most frequent successors that pass
+    numberKept = 0;
+
+    for (unsigned int j = 0; j < numberOfSuccessors; j++)
+    {
+      position = ranks[j].word;
+      word = successors[position].word;
+
+      keepSuccessors[position] = (word == trie->words[i].prediction) ||
+                                 (keepWords[word] && (successors[position].count >= minimumSuccessorCount) &&
+                                  ((maximumSuccessors <= 0) || (numberKept < (unsigned int) maximumSuccessors)));
+
+      numberKept += keepSuccessors[position];
+    }
+
+    position = 0;
+
+    // a subtrie without words stays, as packTrie keeps it
+    if (pruneTrieNode(trie, node->subtrie, keepSuccessors, &position) && (numberOfSuccessors > 0))
+      node->subtrie = 0;
+  }
+
+  // unlinks the nodes of the main trie left without a word below them
+  pruneTrieNode(trie, 0, NULL, NULL);
+
+  // renumbers the words kept, in the same order
+  for (unsigned int i = 0; i < trie->numberOfWords; i++)
+  {
+    if (!keepWords[i])
+      continue;
+
+    newIds[i] = numberOfWords;
+    trie->words[numberOfWords] = trie->words[i];
+    trie->words[numberOfWords].spelling = spellingsLength;
+
+    strcpy(spellings + spellingsLength, getWordSpelling(trie, i));
+    spellingsLength += strlen(spellings + spellingsLength) + 1;
+    numberOfWords++;
+  }
+
+  for (unsigned int i = 0; i < numberOfWords; i++)
+    trie->words[i].prediction = newIds[trie->words[i].prediction];
+
+  // every node refers to the new ids, those of the nodes dropped included
+  for (long id = 0; id < trie->numberOfNodes; id++)
+  {
+    node = getNode(trie, id);
+    node->word = newIds[node->word];
+  }
+
+  free(trie->spellings);
+
+  trie->spellings = spellings;
+  trie->spellingsLength = spellingsLength;
+  trie->spellingsSize = spellingsLength;
+  trie->numberOfWords = numberOfWords;
+
+  // the buffers only shrink, so they stay where they are if they cannot move
+  spellings = realloc(trie->spellings, spellingsLength);
+  words = realloc(trie->words, numberOfWords * sizeof(TrieWord));
+
+  if (spellings != NULL)
+    trie->spellings = spellings;
+
+  if (words != NULL)
+  {
+    trie->words = words;
+    trie->wordTableSize = numberOfWords;
+  }
+
+  free(keepWords);
+  free(keepSuccessors);
+  free(newIds);
+  free(successors);
+  free(ranks);
+
+  // the ranking by id covers nodes that are gone
+  free(trie->ranks);
+  trie->ranks = NULL;
+
+  // drops the nodes unlinked; without memory to lay the trie out, they only stay allocated
+  if (packed)
+    return packTrie(trie);
+
+  trie->frozen = false;
+  freezeTrie(trie);
+
+  return true;
+}
+
+/****************************************************************
+ * Auxiliary function. Prunes the nodes below a node, the node
+ * included, and unlinks those left without a word below them. In
+ * a successor subtrie, the successors are numbered in alphabetical
+ * order, and those not kept stop being words first.
+ *
+ * @param		trie		      trie being compacted
+ * @param		id		        id of the node
+ * @param		keep		      whether each successor is kept, or NULL to only unlink the empty nodes
+ * @param		position		  successors visited so far, incremented
+ *
+ * @return  bool          true if the node is left without a word below it; otherwise, false
+ */
+bool pruneTrieNode (Trie* trie, unsigned int id, bool* keep, unsigned int* position)
+{
+  TrieNode*     node = getNode(trie, id);   // node being pruned
+  unsigned int* link;                        // link to a child
+
+  if ((keep != NULL) && (node->count > 0) && (node->word != 0) && !keep[(*position)++])
+  {
+    node->count = 0;
+    node->word = 0;
+  }
+
+  for (link = &node->child; *link != 0; )
+  {
+    if (pruneTrieNode(trie, *link, keep, position))
+      *link = getNode(trie, *link)->sibling;
+    else
+      link = &getNode(trie, *link)->sibling;
+  }
+
+  return (node->count == 0) && (node->word == 0) && (node->child == 0) && (node->subtrie == 0);
+}
+
+/****************************************************************
+ * Checks if a word has successors, in a subtrie or, if the trie is
+ * packed, in the successor arrays. A word followed only by words
+ * without letters, such as numbers, has a subtrie without words,
+ * and so has successors, none of which is listed; a packed trie
+ * keeps that empty subtrie.
+ *
+ * @param		trie		      trie that owns the node
+ * @param		node		      node that ends the word, in the main trie
+ *
+ * @return  bool          true if the word has successors; otherwise, false
+ */
+bool hasSuccessors (Trie* trie, const TrieNode* node)
+{
+  if (trie->successorOffsets != NULL)
+    return (trie->successorOffsets[node->word + 1] > trie->successorOffsets[node->word]) || (node->subtrie != 0);
+
+  return (node->subtrie != 0);
+}
+
+/****************************************************************
+ * Chooses how the prediction command, '@', picks each word: the
+ * most frequent successor, by default, the most likely chain of a
+ * beam search, or successors drawn at random. Must be called
+ * before the trie is queried.
+ *
+ * @param		trie		      trie to be queried
+ * @param		beamWidth		  number of chains kept by the beam search, or 0
+ * @param		sampleSize		number of most frequent successors drawn from, or 0
+ * @param		temperature		exponent of 1 / temperature applied to the counts drawn from
+ * @param		seed		      seed of the draws
+ */
+void setPredictionMode (Trie* trie, int beamWidth, int sampleSize, double temperature, unsigned long long seed)
+{
+  // consistency
+  if (trie == NULL)
+    return;
+
+  trie->beamWidth = (beamWidth > 0) ? beamWidth : 0;
+  trie->sampleSize = (sampleSize > 0) ? sampleSize : 0;
+  trie->temperature = temperature;
+  trie->seed = seed;
+}
+
+/****************************************************************
+ * Gets node from its id.
+ *
+ * @param		trie		      trie that owns the node
+ * @param		id		        id of the node
+ *
+ * @return	TrieNode*     node of the trie
+ */
+TrieNode* getNode (Trie* trie, unsigned int id)
+{
+  return &trie->slabs[id >> TRIE_SLAB_BITS][id & (TRIE_SLAB_SIZE - 1)];
+}
+
+/****************************************************************
+ * Gets first child of a node, in alphabetical order.
+ *
+ * @param		trie		      trie that owns the node
+ * @param		node		      node of the trie
+ *
+ * @return	TrieNode*     first child, or NULL if there are no children
+ */
+TrieNode* getFirstChild (Trie* trie, TrieNode* node)
+{
+  if (node->child == 0)
+    return NULL;
+
+  return getNode(trie, node->child);
+}
+
+/****************************************************************
+ * Gets next sibling of a node, in alphabetical order.
+ *
+ * @param		trie		      trie that owns the node
+ * @param		node		      node of the trie
+ *
+ * @return	TrieNode*     next sibling, or NULL if it is the last child
+ */
+TrieNode* getNextSibling (Trie* trie, TrieNode* node)
+{
+  if (node->sibling == 0)
+    return NULL;
+
+  return getNode(trie, node->sibling);
+}
+
+/****************************************************************
+ * Gets id of the child of a node by letter. In a frozen trie the
+ * child is where its letter puts it, if it exists; otherwise the
+ * siblings are searched in order.
+ *
+ * @param		trie		      trie that owns the node
+ * @param		node		      node of the trie
+ * @param		letter		    letter of the child
+ *
+ * @return	unsigned int  id of the child, or 0 if it does not exist
+ */
+unsigned int getChildId (Trie* trie, TrieNode* node, char letter)
+{
+  TrieNode*    child;   // child of the node
+  unsigned int id;      // id of the child
+
+  if (node->child == 0)
+    return 0;
+
+  // the children of a frozen node sit at the distance of their letter from the first one
+  if (trie->frozen)
+  {
+    child = getNode(trie, node->child);
+    COUNT_STAT(siblingVisits, 1);
+
+    if ((unsigned char) letter < (unsigned char) child->letter)
+      return 0;
+
+    id = node->child + ((unsigned char) letter - (unsigned char) child->letter);
+
+    return ((id < trie->numberOfNodes) && (getNode(trie, id)->letter == letter)) ? id : 0;
+  }
+
+  // children are sorted by byte value, so the search stops at the first greater letter
+  for (id = node->child; id != 0; id = child->sibling)
+  {
+    child = getNode(trie, id);
+    COUNT_STAT(siblingVisits, 1);
+
+    if ((unsigned char) child->letter >= (unsigned char) letter)
+      return (child->letter == letter) ? id : 0;
+  }
+
+  return 0;
+}
+
+/****************************************************************
+ * Gets child of a node by letter, creating it in alphabetical
+ * position if it does not exist.
+ *
+ * @param		trie		      trie that owns the node
+ * @param		node		      node of the trie
+ * @param		letter		    letter of the child
+ * @param		id		        receives the id of the child, if not NULL
+ *
+ * @return	TrieNode*     child node, or NULL if out of memory
+ */
+TrieNode* getOrCreateChild (Trie* trie, TrieNode* node, char letter, unsigned int* id)
+{
+  TrieNode*     child;       // child of the node
+  unsigned int* link;        // link that will point to the new child
+  unsigned int  childId;     // id of the new child
+
+  // finds the link after which the letter belongs
+  link = &node->child;
+
+  while (*link != 0)
+  {
+    child = getNode(trie, *link);
+    COUNT_STAT(siblingVisits, 1);
+
+    if (child->letter == letter)
+    {
+      // the first letter of a compressed edge gets a node of its own
+      if ((child->labelLength > 0) && ((child = splitEdge(trie, link)) == NULL))
+        return NULL;
+
+      if (id != NULL)
+        *id = *link;
+
+      return child;
+    }
+
+    if ((unsigned char) child->letter > (unsigned char) letter)
+      break;
+
+    link = &child->sibling;
+  }
+
+  // creates node; its slab never moves, so link stays valid
+  child = createTrieNode(trie, &childId);
+
+  // consistency
+  if (child == NULL)
+    return NULL;
+
+  // a new node is not where a frozen trie would look for it
+  trie->frozen = false;
+
+  // links child between its neighbours
+  child->letter = letter;
+  child->sibling = *link;
+  *link = childId;
+
+  if (id != NULL)
+    *id = childId;
+
+  return child;
+}
+
+/****************************************************************
+ * Auxiliary function. Splits a compressed edge after its first
+ * letter: a new node with that letter takes the place of the node
+ * of the edge among its siblings, and the node of the edge, with
+ * the rest of its letters, becomes its only child. The node of the
+ * edge keeps its id, so word records still point to it.
+ *
+ * @param		trie		      trie that owns the edge
+ * @param		link		      link that points to the node of the edge
+ *
+ * @return	TrieNode*     node of the first letter, or NULL if out of memory
+ */
+TrieNode* splitEdge (Trie* trie, unsigned int* link)
+{
+  TrieNode*    edge = getNode(trie, *link);   // node of the edge
+  TrieNode*    node;                          // node of its first letter
+  unsigned int id;                            // id of that node
+
+  // creates node; slabs never move, so the link and the edge stay valid
+  node = createTrieNode(trie, &id);
+
+  // consistency
+  if (node == NULL)
+    return NULL;
+
+  // a new node is not where a frozen trie would look for it
+  trie->frozen = false;
+
+  node->letter = edge->letter;
+  node->sibling = edge->sibling;
+  node->child = *link;
+
+  // the edge loses its first letter
+  edge->letter = trie->labelText[trie->labels[*link]];
+  edge->sibling = 0;
+  edge->labelLength--;
+  trie->labels[*link]++;
+
+  // the same words are below both nodes
+  if (trie->ranks != NULL)
+    trie->ranks[id] = trie->ranks[*link];
+
+  *link = id;
+
+  return node;
+}
+
+/****************************************************************
+ * Gets the letters of the edge that leads to a node after the
+ * first one, which is the letter of the node.
+ *
+ * @param		trie		      trie that owns the node
+ * @param		id		        id of the node
+ *
+ * @return	char*         labelLength letters of the edge, not null-terminated
+ */
+char* getEdgeLabel (Trie* trie, unsigned int id)
+{
+  return (getNode(trie, id)->labelLength > 0) ? trie->labelText + trie->labels[id] : "";
+}
+
+/****************************************************************
+ * Adds a word record for a node of the main trie.
+ *
+ * @param		trie		      trie that owns the record
+ * @param		node		      id of the node that ends the word
+ * @param		word		      spelling of the word
+ *
+ * @return	unsigned int  id of the new record, or 0 if out of memory
+ */
+unsigned int addTrieWord (Trie* trie, unsigned int node, char* word)
+{
+  TrieWord*    words;       // resized word table
+  char*        spellings;   // resized spellings buffer
+  unsigned int length,      // number of letters of the word, with terminator
+               size;        // new size of a table
+
+  length = strlen(word) + 1;
+
+  // grows word table when it is full
+  if (trie->numberOfWords == trie->wordTableSize)
+  {
+    size = 2 * (trie->wordTableSize + 1);
+    words = realloc(trie->words, size * sizeof(TrieWord));
+
+    // consistency
+    if (words == NULL)
+      return 0;
+
+    trie->words = words;
+    trie->wordTableSize = size;
+  }
+
+  // grows spellings buffer when the word does not fit
+  if (trie->spellingsLength + length > trie->spellingsSize)
+  {
+    size = 2 * (trie->spellingsSize + length);
+    spellings = realloc(trie->spellings, size);
+
+    // consistency
+    if (spellings == NULL)
+      return 0;
+
+    trie->spellings = spellings;
+    trie->spellingsSize = size;
+  }
+
+  // appends spelling
+  memcpy(trie->spellings + trie->spellingsLength, word, length);
+
+  // fills record
+  trie->words[trie->numberOfWords].node = node;
+  trie->words[trie->numberOfWords].spelling = trie->spellingsLength;
+  trie->words[trie->numberOfWords].prediction = 0;
+  trie->words[trie->numberOfWords].predictionCount = 0;
+
+  trie->spellingsLength += length;
+  COUNT_STAT(wordAllocations, 1);
+
+  return trie->numberOfWords++;
+}
+
+/****************************************************************
+ * Gets spelling of a word.
+ *
+ * @param		trie		      trie that owns the record
+ * @param		word		      id of the word record
+ *
+ * @return	char*         spelling of the word, valid until the next insertion
+ */
+char* getWordSpelling (Trie* trie, unsigned int word)
+{
+  return trie->spellings + trie->words[word].spelling;
+}
+
+/****************************************************************
+ * Updates the cached prediction of a word after one of its
+ * successors was counted once more. Counts only grow, so the
+ * successor either takes over or the cached one still wins.
+ *
+ * @param		trie		      trie that owns the records
+ * @param		word		      record of the previous word
+ * @param		successor	    node of the successor in the previous word subtrie
+ */
+void updateTextPrediction (Trie* trie, TrieWord* word, TrieNode* successor)
+{
+  // most frequent word, or first in alphabetical order among the most frequent
+  if ((successor->count > word->predictionCount) ||
+      ((successor->count == word->predictionCount) &&
+       (strcmp(getWordSpelling(trie, successor->word), getWordSpelling(trie, word->prediction)) < 0)))
+  {
+    word->prediction = successor->word;
+    word->predictionCount = successor->count;
+  }
+}
+
+/****************************************************************
+ * Prints all trie contents on screen.
+ *
+ * @param		trie		      trie that owns the root
+ * @param		root		      root of the trie
+ * @param		output		    output the words are written to
+ */
+void printTrieSimpleFormat (Trie* trie, TrieNode* root, TrieOutput* output)
+{
+   /*
+    Creates string called rootWord to hold first letter of the word.
+    Cycles recursively through nodes to append the letters into the word string.
+    Once the count is greater than zero, which indicates end-of-word,
+    that is when the word and its count are printed on screen.
+
+    Since each node index represents a letter, it converts that index
+    into a char to be appended to the word string.
+ */
+
+  char      rootWord[MAX_CHARACTERS_PER_WORD + 2];    // word to be completed by node content
+  TrieNode* child;                                      // child of the root
+
+  // consistency
+  if (root == NULL)
+    return;
+
+  // cycles through children
+  for (unsigned int id = root->child; id != 0; id = child->sibling)
+  {
+    child = getNode(trie, id);
+
+    // inserts first letter, and the rest of a compressed edge, into word string
+    rootWord[0] = child->letter;
+    memcpy(rootWord + 1, getEdgeLabel(trie, id), child->labelLength);
+
+    // recursive call into child nodes
+    printTrieNodeWordsSimpleFormat(trie, child, rootWord, 1 + child->labelLength, output);
+  }
+}
+
+/****************************************************************
+ * Auxiliary function. Prints trie node words on screen. Letters
+ * are appended in place, so the buffer holds the word of the node
+ * being visited.
+ *
+ * @param		trie		      trie that owns the node
+ * @param		node		      node of the trie
+ * @param		word		      buffer to store the letters of the word, through the nodes
+ * @param		length		    number of characters of the word so far
+ * @param		output		    output the words are written to
+ */
+void printTrieNodeWordsSimpleFormat (Trie* trie, TrieNode* node, char* word, int length,
+                                     TrieOutput* output)
+{
+  TrieNode* child;   // child of the node
+
+  // consistency
+  if (node == NULL)
+    return;
+
+  // when the count is greater than zero, it has reached the end of a word
+  if (node->count > 0)
+  {
+    writeOutput(output, word, length);
+    writeOutput(output, " (", 2);
+    writeOutputNumber(output, node->count);
+    writeOutput(output, ")\n", 2);
+  }
+
+  // cycles through children to append letters to the word
+  for (unsigned int id = node->child; id != 0; id = child->sibling)
+  {
+    child = getNode(trie, id);
+
+    // consistency; words are shorter than the buffer
+    if (length + 1 + child->labelLength > MAX_CHARACTERS_PER_WORD + 1)
+      continue;
+
+    // appends next letter, and the rest of a compressed edge, into word string
+    word[length] = child->letter;
+    memcpy(word + length + 1, getEdgeLabel(trie, id), child->labelLength);
+
+    // recursive call to print child nodes
+    printTrieNodeWordsSimpleFormat(trie, child, word, length + 1 + child->labelLength, output);
+  }
+}
+
+/****************************************************************
+ * Checks if node has children.
+ *
+ * @param		node		      node of the trie
+ *
+ * @return  bool          true if has children; otherwise, false
+ */
+bool hasChildren (TrieNode* node)
+{
+  // consistency
+  if (node == NULL)
+    return false;
+
+  // checks if there is at least one child
+  return (node->child != 0);
+}
+
+/****************************************************************
+ * Gets number of child nodes.
+ *
+ * @param		trie		      trie that owns the node
+ * @param		node		      node of the trie
+ *
+ * @return  int           number of children
+ */
+int getNumberOfChildren (Trie* trie, TrieNode* node)
+{
+  int numberOfChildren = 0;   // number of children of the node
+
+  // consistency
+  if (node == NULL)
+    return 0;
+
+  // traverses the list of children
+  for (TrieNode* child = getFirstChild(trie, node); child != NULL; child = getNextSibling(trie, child))
+    numberOfChildren++;
+
+  // returns counter
+  return numberOfChildren;
+}
+
+/****************************************************************
+ * Gets node. As when words are inserted, characters other than
+ * letters are skipped, and letters past the first
+ * MAX_CHARACTERS_PER_WORD - 1 are dropped.
+ *
+ * @param		trie		      trie that owns the root
+ * @param		root		      root of the trie
+ * @param		word		      string with the word to be found
+ *
+ * @return  const TrieNode*  node of the trie, read-only: it may be shared by
+ *                           every word that ends inside a compressed edge
+ */
+const TrieNode* getTrieNode (Trie* trie, TrieNode* root, char* word)
+{
+  TrieNode*     node = NULL;    // node of the trie
+  unsigned char character;      // current character of the word
+  unsigned int  id;             // id of the node
+  char*         label = NULL;   // letters of its edge not yet matched, if compressed
+  int           remaining = 0,  // number of those letters
+                length = 0;     // number of letters of the word matched so far
+
+  // consistency
+  if ((root == NULL) || (word == NULL))
+    return NULL;
+
+  // starts search at root
+  node = root;
+  COUNT_STAT(lookups, 1);
+
+  // cycles through children, skipping punctuation marks; the word is not modified
+  for (; *word != '\0'; word++)
+  {
+    character = *word;
+
+    // a space inside the word can never match
+    if (character == ' ')
+      return NULL;
+
+    // letters past the word limit are dropped, as when the corpus was inserted
+    if (!isLetter(character, trie->alphabet) || (length == MAX_CHARACTERS_PER_WORD - 1))
+      continue;
+
+    length++;
+
+    // goes on along a compressed edge
+    if (remaining > 0)
+    {
+      if (*label != toLowercase(character))
+        return NULL;
+
+      label++;
+      remaining--;
+      continue;
+    }
+
+    // searches for next letter
+    id = getChildId(trie, node, toLowercase(character));
+    COUNT_STAT(lookupVisits, 1);
+
+    // if the pointer is at the last non-null node, it found the word
+    if (id == 0)
+      return NULL;
+
+    node = getNode(trie, id);
+    remaining = node->labelLength;
+    label = getEdgeLabel(trie, id);
+  }
+
+  // a word without letters is not in the trie
+  if (node == root)
+    return NULL;
+
+  // a word that ends inside a compressed edge is only a prefix, with no count
+  if (remaining > 0)
+    return &edgeNode;
+
+  return node;
+}
+
+/****************************************************************
+ * Inserts phrase into trie root.
+ *
+ * @param		trie		      trie that receives the words
+ * @param		phrase		    string with words
+ */
+void insertPhrase (Trie* trie, char* phrase)
+{
+  TrieReader reader = {0};   // phrase starts a new line
+
+  // consistency
+  if ((trie == NULL) || (phrase == NULL))
+    return;
+
+  // inserts words of the phrase, then its last word
+  insertBlock(trie, &reader, phrase, strlen(phrase));
+  endWord(trie, &reader);
+}
+
+/****************************************************************
+ * Inserts the words of a block of text. Words are separated by
+ * spaces, lines by newlines, and other characters are ignored.
+ * A word or line cut at the end of the block is carried in the
+ * reader to the next block.
+ *
+ * @param		trie		      trie that receives the words
+ * @param		reader		    state carried between blocks
+ * @param		block		      block of text
+ * @param		length		    number of characters in the block
+ */
+void insertBlock (Trie* trie, TrieReader* reader, char* block, size_t length)
+{
+  unsigned char character;       // current character of the block
+  unsigned int  letters = 0;     // bit of each letter of the chunk, from the current character on
+  size_t        chunkEnd = 0,    // end of the chunk of characters classified at once
+                run,             // number of letters from the current character on
+                room;            // number of letters the word can still take
+
+  for (size_t i = 0; i < length; )
+  {
+    // classifies the next 32 characters at once, and the last ones one at a time
+    if (i == chunkEnd)
+    {
+      chunkEnd = (i + TOKEN_CHUNK_SIZE <= length) ? i + TOKEN_CHUNK_SIZE : i + 1;
+      letters = (chunkEnd - i == TOKEN_CHUNK_SIZE) ? getLetterMask(block + i, trie->alphabet)
+                                                   : isLetter(block[i], trie->alphabet);
+    }
+
+    // adds the run of letters to the word at once, lowercased; letters past the word limit are dropped
+    if (letters & 1)
+    {
+      run = (letters == UINT_MAX) ? TOKEN_CHUNK_SIZE : (size_t) __builtin_ctz(~letters);
+      room = MAX_CHARACTERS_PER_WORD - 1 - reader->wordLength;
+      room = (run < room) ? run : room;
+
+      copyLowercase(reader->word + reader->wordLength, block + i, room);
+      reader->wordLength += room;
+      letters = (run < TOKEN_CHUNK_SIZE) ? letters >> run : 0;
+      i += run;
+
+      continue;
+    }
+
+    character = block[i];
+
+    // a space ends the word
+    if (character == ' ')
+    {
+      endWord(trie, reader);
+    }
+
+    // a newline ends the word and the line
+    else if (character == '\n')
+    {
+      endWord(trie, reader);
+      reader->previousWordNode = NULL;
+    }
+
+    letters >>= 1;
+    i++;
+  }
+}
+
+/****************************************************************
+ * Inserts the word being scanned after the previous word of its
+ * line. An empty word, from consecutive spaces, breaks the chain.
+ *
+ * @param		trie		      trie that receives the word
+ * @param		reader		    state with the word and the previous word
+ */
+void endWord (Trie* trie, TrieReader* reader)
+{
+  // finalizes word string
+  reader->word[reader->wordLength] = '\0';
+
+  // inserts word, which becomes the previous word
+  reader->previousWordNode = insertNextWord(trie, reader->previousWordNode, reader->word,
+                                            reader->contextNodes);
+
+  // resets index
+  reader->wordLength = 0;
+}
+
+/****************************************************************
+ * Checks if a character is a letter of an alphabet. Letters a to
+ * z are found as isalpha does in the C locale, without a table
+ * lookup: setting bit 5 lowercases the letters and maps no other
+ * character to one. The bytes alphabet adds the digits and every
+ * byte of 0x80 and above, so the bytes of a UTF-8 character are
+ * all letters and an accented word stays whole.
+ *
+ * @param		character		  character to be checked
+ * @param		alphabet		  TRIE_ALPHABET_LETTERS or TRIE_ALPHABET_BYTES
+ *
+ * @return  bool          true if the character is a letter; otherwise, false
+ */
+bool isLetter (unsigned char character, int alphabet)
+{
+  return ((unsigned char) ((character | 0x20) - 'a') < 26) ||
+         ((alphabet == TRIE_ALPHABET_BYTES) && ((character >= 0x80) || ((unsigned char) (character - '0') < 10)));
+}
+
+/****************************************************************
+ * Lowercases the letters A to Z, as tolower does in the C locale,
+ * and leaves every other character, UTF-8 bytes included, as it is.
+ *
+ * @param		character		  character to be lowercased
+ *
+ * @return  char          lowercase character
+ */
+char toLowercase (unsigned char character)
+{
+  return character | (((unsigned char) (character - 'A') < 26) << 5);
+}
+
+/****************************************************************
+ * Finds the letters among the next 32 characters of a text, with
+ * the widest vector instructions of the processor, checked at run
+ * time, or in plain C when built with -DTRIE_SCALAR or for another
+ * architecture. A block is thus classified once per 32 characters,
+ * and each run of letters is found with a count of trailing ones.
+ *
+ * @param		text		      text with at least 32 characters
+ * @param		alphabet		  TRIE_ALPHABET_LETTERS or TRIE_ALPHABET_BYTES
+ *
+ * @return  unsigned int  mask with bit i set if character i is a letter
+ */
+unsigned int getLetterMask (char* text, int alphabet)
+{
+#ifdef TRIE_SIMD
+  if (__builtin_cpu_supports("avx2"))
+    return getLetterMaskAvx2(text, alphabet);
+
+  return getLetterMaskSse2(text, alphabet);
+#else
+  return getLetterMaskScalar(text, alphabet);
+#endif
+}
+
+/****************************************************************
+ * Auxiliary function. Finds the letters among the next 32
+ * characters of a text, one character at a time. See getLetterMask.
+ *
+ * @param		text		      text with at least 32 characters
+ * @param		alphabet		  TRIE_ALPHABET_LETTERS or TRIE_ALPHABET_BYTES
+ *
+ * @return  unsigned int  mask with bit i set if character i is a letter
+ */
+unsigned int getLetterMaskScalar (char* text, int alphabet)
+{
+  unsigned int mask = 0;   // bit of each letter
+
+  for (int i = 0; i < TOKEN_CHUNK_SIZE; i++)
+    mask |= (unsigned int) isLetter(text[i], alphabet) << i;
+
+  return mask;
+}
+
+#ifdef TRIE_SIMD
+/****************************************************************
+ * Auxiliary function. Finds the letters among the next 32
+ * characters of a text, 16 at a time: each character is lowercased
+ * by setting bit 5 and compared with 'a' and 'z', and the results
+ * are gathered in a bit mask. Characters of 0x80 and above compare
+ * as negative, so they are not letters. In the bytes alphabet, the
+ * digits are compared the same way and the bytes of 0x80 and above
+ * are taken from their top bit. SSE2 is part of every x86-64
+ * processor. See getLetterMask.
+ *
+ * @param		text		      text with at least 32 characters
+ * @param		alphabet		  TRIE_ALPHABET_LETTERS or TRIE_ALPHABET_BYTES
+ *
+ * @return  unsigned int  mask with bit i set if character i is a letter
+ */
+unsigned int getLetterMaskSse2 (char* text, int alphabet)
+{
+  __m128i      lowercase = _mm_set1_epi8(0x20),     // bit that lowercases a letter
+               beforeA = _mm_set1_epi8('a' - 1),    // character before the letters
+               afterZ = _mm_set1_epi8('z' + 1),     // character after the letters
+               beforeZero = _mm_set1_epi8('0' - 1), // character before the digits
+               afterNine = _mm_set1_epi8('9' + 1),  // character after the digits
+               characters,                          // characters being tested
+               chunk;                               // the same characters, lowercased
+  unsigned int mask = 0;                            // bit of each letter
+
+  for (int i = 0; i < TOKEN_CHUNK_SIZE; i += 16)
+  {
+    characters = _mm_loadu_si128((__m128i*) (text + i));
+    chunk = _mm_or_si128(characters, lowercase);
+    mask |= (unsigned int) _mm_movemask_epi8(_mm_and_si128(_mm_cmpgt_epi8(chunk, beforeA),
+                                                           _mm_cmpgt_epi8(afterZ, chunk))) << i;
+
+    if (alphabet == TRIE_ALPHABET_BYTES)
+      mask |= (unsigned int) _mm_movemask_epi8(_mm_or_si128(characters,
+                                                            _mm_and_si128(_mm_cmpgt_epi8(characters, beforeZero),
+                                                                          _mm_cmpgt_epi8(afterNine, characters)))) << i;
+  }
+
+  return mask;
+}
+
+/****************************************************************
+ * Auxiliary function. Finds the letters among the next 32
+ * characters of a text at once, as getLetterMaskSse2 does 16 at a
+ * time. Only called on processors with AVX2. See getLetterMask.
+ *
+ * @param		text		      text with at least 32 characters
+ * @param		alphabet		  TRIE_ALPHABET_LETTERS or TRIE_ALPHABET_BYTES
+ *
+ * @return  unsigned int  mask with bit i set if character i is a letter
+ */
+__attribute__((target("avx2")))
+unsigned int getLetterMaskAvx2 (char* text, int alphabet)
+{
+  __m256i      lowercase = _mm256_set1_epi8(0x20),      // bit that lowercases a letter
+               beforeA = _mm256_set1_epi8('a' - 1),     // character before the letters
+               afterZ = _mm256_set1_epi8('z' + 1),      // character after the letters
+               beforeZero = _mm256_set1_epi8('0' - 1),  // character before the digits
+               afterNine = _mm256_set1_epi8('9' + 1),   // character after the digits
+               characters,                              // characters being tested
+               chunk;                                   // the same characters, lowercased
+  unsigned int mask;                                    // bit of each letter
+
+  characters = _mm256_loadu_si256((__m256i*) text);
+  chunk = _mm256_or_si256(characters, lowercase);
+  mask = _mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpgt_epi8(chunk, beforeA), _mm256_cmpgt_epi8(afterZ, chunk)));
+
+  if (alphabet == TRIE_ALPHABET_BYTES)
+    mask |= _mm256_movemask_epi8(_mm256_or_si256(characters,
+                                                 _mm256_and_si256(_mm256_cmpgt_epi8(characters, beforeZero),
+                                                                  _mm256_cmpgt_epi8(afterNine, characters))));
+
+  return mask;
+}
+#endif
+
+/****************************************************************
+ * Auxiliary function. Copies letters, with A to Z lowercased by
+ * setting bit 5 and other letters as they are, in a loop simple
+ * enough for the compiler to vectorize.
+ *
+ * @param		word		      buffer the letters are copied to
+ * @param		text		      letters to be copied
+ * @param		length		    number of letters
+ */
+void copyLowercase (char* word, char* text, size_t length)
+{
+  for (size_t i = 0; i < length; i++)
+    word[i] = text[i] | (((unsigned char) (text[i] - 'A') < 26) << 5);
+}
+
+/****************************************************************
+ * Inserts word into trie root and into the subtrie of the word
+ * that precedes it.
+ *
+ * @param		trie		      trie that receives the word
+ * @param		previousWordNode  node of the previous word, or NULL
+ * @param		word		      lowercase word, possibly empty
+ *
+ * @return  TrieNode*     node of the word in the root, or NULL if it is empty
+ */
+TrieNode* insertNextWord (Trie* trie, TrieNode* previousWordNode, char* word,
+                          TrieNode** contextNodes)
+{
+  TrieNode*    wordNode,                      // node of the word in the root
+              *successorNode = NULL;          // node of the word in the previous word subtrie
+  unsigned int wordNodeId;                    // id of the node of the word in the root
+
+  // inserts word into previous word subtrie, unless a sketch counts the pairs
+  if ((previousWordNode != NULL) && (trie->sketch == NULL))
+  {
+    if (previousWordNode->subtrie == 0)
+      createTrieNode(trie, &previousWordNode->subtrie);
+
+    successorNode = insertWord(trie, getNode(trie, previousWordNode->subtrie), word, NULL);
+  }
+
+  // a sketch counts no pair with a word without letters, but the previous word gets its empty
+  // subtrie all the same, so that it has successors as in an exact build; see packSketchCandidates
+  else if ((previousWordNode != NULL) && (previousWordNode->subtrie == 0) && (word[0] == '\0'))
+    createTrieNode(trie, &previousWordNode->subtrie);
+
+  // recursively inserts word into root
+  wordNode = insertWord(trie, trie->root, word, &wordNodeId);
+
+  // consistency
+  if (wordNode == NULL)
+    return NULL;
+
+  linkWord(trie, previousWordNode, wordNode, wordNodeId, successorNode, word, contextNodes);
+
+  if ((trie->sketch != NULL) && (previousWordNode != NULL))
+    countSketchPair(trie, previousWordNode->word, wordNode->word);
+
+  return wordNode;
+}
+
+/****************************************************************
+ * Inserts the words of a text held in memory, such as a mapped
+ * file. Follows the same rules as insertBlock, but descends the
+ * root and the previous word subtrie letter by letter as the text
+ * is scanned, so words are never copied.
+ *
+ * @param		trie		      trie that receives the words
+ * @param		text		      text with words
+ * @param		length		    number of characters in the text
+ */
+void insertText (Trie* trie, char* text, size_t length)
+{
+  TrieNode*     previousWordNode = NULL,  // node of the previous word of the line
+               *wordNode,                 // node of the letters scanned so far, in the root
+               *successorNode = NULL;     // node of the same letters, in the previous word subtrie
+  unsigned int  wordNodeId = 0;           // id of the node of the word in the root
+  size_t        wordStart = 0;            // index of the first letter of the word
+  int           wordLength = 0;           // number of letters of the word
+  unsigned char character;                // current character of the text
+  TrieNode*     contextNodes[TRIE_MAX_ORDER - 2] = {0};   // contexts ending at the previous word
+
+  wordNode = trie->root;
+
+  // the end of the text ends the last line
+  for (size_t i = 0; i <= length; i++)
+  {
+    character = (i < length) ? text[i] : '\n';
+
+    // descends one letter; letters past the word limit are dropped
+    if (isLetter(character, trie->alphabet))
+    {
+      if (wordLength == MAX_CHARACTERS_PER_WORD - 1)
+        continue;
+
+      // first letter starts the descent of the previous word subtrie
+      if (wordLength == 0)
+      {
+        wordStart = i;
+
+        if (previousWordNode != NULL)
+        {
+          if (previousWordNode->subtrie == 0)
+            createTrieNode(trie, &previousWordNode->subtrie);
+
+          successorNode = getNode(trie, previousWordNode->subtrie);
+        }
+      }
+
+      wordNode = getOrCreateChild(trie, wordNode, toLowercase(character), &wordNodeId);
+      COUNT_STAT(insertVisits, 1);
+
+      if (successorNode != NULL)
+        successorNode = getOrCreateChild(trie, successorNode, toLowercase(character), NULL);
+
+      // consistency
+      if (wordNode == NULL)
+        return;
+
+      wordLength++;
+    }
+
+    // a space ends the word and a newline also ends the line
+    else if ((character == ' ') || (character == '\n'))
+    {
+      previousWordNode = endTextWord(trie, previousWordNode, (wordLength > 0) ? wordNode : NULL,
+                                     wordNodeId, successorNode, text + wordStart, i - wordStart,
+                                     contextNodes);
+
+      if (character == '\n')
+        previousWordNode = NULL;
+
+      // restarts at the root
+      wordNode = trie->root;
+      successorNode = NULL;
+      wordLength = 0;
+    }
+  }
+}
+
+/****************************************************************
+ * Counts a word reached by insertText.
+ *
+ * @param		trie		      trie that receives the word
+ * @param		previousWordNode  node of the previous word, or NULL
+ * @param		wordNode		  node of the word in the root, or NULL if it is empty
+ * @param		wordNodeId		id of the node of the word in the root
+ * @param		successorNode	node of the word in the previous word subtrie, or NULL
+ * @param		text		      characters of the word, punctuation included
+ * @param		length		    number of characters of the word
+ * @param		contextNodes	contexts of two or more words ending at the previous word
+ *
+ * @return  TrieNode*     node of the word in the root, or NULL if it is empty
+ */
+TrieNode* endTextWord (Trie* trie, TrieNode* previousWordNode, TrieNode* wordNode,
+                       unsigned int wordNodeId, TrieNode* successorNode,
+                       char* text, size_t length, TrieNode** contextNodes)
+{
+  char  word[MAX_CHARACTERS_PER_WORD];    // spelling of a new word
+  int   wordLength = 0;                   // number of letters of the spelling
+
+  // an empty word still opens the previous word subtrie
+  if (wordNode == NULL)
+  {
+    if ((previousWordNode != NULL) && (previousWordNode->subtrie == 0))
+      createTrieNode(trie, &previousWordNode->subtrie);
+
+    return NULL;
+  }
+
+  wordNode->count++;
+
+  if (successorNode != NULL)
+    successorNode->count++;
+
+  // spells a new word from its characters, the only time they are copied
+  if (wordNode->word == 0)
+  {
+    for (size_t i = 0; (i < length) && (wordLength < MAX_CHARACTERS_PER_WORD - 1); i++)
+    {
+      if (isLetter(text[i], trie->alphabet))
+      {
+        word[wordLength] = toLowercase(text[i]);
+        wordLength++;
+      }
+    }
+  }
+
+  word[wordLength] = '\0';
+
+  linkWord(trie, previousWordNode, wordNode, wordNodeId, successorNode, word, contextNodes);
+
+  return wordNode;
+}
+
+/****************************************************************
+ * Creates the record of a word inserted for the first time, links
+ * its node in the previous word subtrie to that record, and updates
+ * the prediction of the previous word.
+ *
+ * @param		trie		      trie that receives the word
+ * @param		previousWordNode  node of the previous word, or NULL
+ * @param		wordNode		  node of the word in the root
+ * @param		wordNodeId		id of the node of the word in the root
+ * @param		successorNode	node of the word in the previous word subtrie, or NULL
+ * @param		word		      spelling of the word, used only if it is new
+ * @param		contextNodes	contexts of two or more words ending at the previous word
+ */
+void linkWord (Trie* trie, TrieNode* previousWordNode, TrieNode* wordNode,
+               unsigned int wordNodeId, TrieNode* successorNode, char* word,
+               TrieNode** contextNodes)
+{
+  COUNT_STAT(insertions, 1);
+
+  // creates record of a new word
+  if (wordNode->word == 0)
+    wordNode->word = addTrieWord(trie, wordNodeId, word);
+
+  // links successor to the word record and updates previous word prediction
+  if ((successorNode != NULL) && (wordNode->word != 0))
+  {
+    successorNode->word = wordNode->word;
+    updateTextPrediction(trie, &trie->words[previousWordNode->word], successorNode);
+  }
+
+  // keeps the ranking current once queries have built it, as words are added to a live trie
+  if ((trie->ranks != NULL) && (wordNode->word != 0))
+  {
+    updateRanks(trie, 0, wordNode->word, wordNode->count);
+
+    if (successorNode != NULL)
+      updateRanks(trie, previousWordNode->subtrie, wordNode->word, successorNode->count);
+  }
+
+  // the word also follows the longer contexts ending at the previous word
+  if (trie->order > 2)
+    linkContexts(trie, previousWordNode, successorNode, wordNode->word, contextNodes);
+}
+
+/****************************************************************
+ * Inserts a word into the subtries of the contexts of two or more
+ * words that end at the previous word, and shifts the contexts so
+ * that they end at this word. The context of k + 1 words ending at
+ * this word is the node of this word under the context of k words
+ * ending at the previous word.
+ *
+ * @param		trie		      trie that receives the word
+ * @param		previousWordNode  node of the previous word, or NULL at the start of a line
+ * @param		successorNode	node of the word in the previous word subtrie, or NULL
+ * @param		word		      id of the word record
+ * @param		contextNodes	contexts ending at the previous word, shortest first
+ */
+void linkContexts (Trie* trie, TrieNode* previousWordNode, TrieNode* successorNode,
+                   unsigned int word, TrieNode** contextNodes)
+{
+  TrieNode* levelNode = successorNode;   // node of the word under the context one word shorter
+  TrieNode* inserted;                    // node of the word under the current context
+
+  // a line, or the words after an empty word, start without context
+  if (previousWordNode == NULL)
+    memset(contextNodes, 0, (trie->order - 2) * sizeof(TrieNode*));
+
+  for (int k = 0; k < trie->order - 2; k++)
+  {
+    inserted = NULL;
+
+    // rare contexts are pruned
+    if ((contextNodes[k] != NULL) && (contextNodes[k]->count >= trie->minimumContextCount) && (word != 0))
+      inserted = insertContextWord(trie, contextNodes[k], word);
+
+    contextNodes[k] = levelNode;
+    levelNode = inserted;
+  }
+}
+
+/****************************************************************
+ * Inserts a word into the subtrie of a context of two or more
+ * words, and updates the most frequent successor of the context,
+ * whose node id is kept in the root of that subtrie.
+ *
+ * @param		trie		      trie that receives the word
+ * @param		context		    node that ends the context
+ * @param		word		      id of the word record
+ *
+ * @return	TrieNode*     node of the word under the context, or NULL if out of memory
+ */
+TrieNode* insertContextWord (Trie* trie, TrieNode* context, unsigned int word)
+{
+  TrieNode*    root;      // root of the subtrie of the context
+  TrieNode*    node;      // node of the word in the subtrie
+  TrieNode*    best;      // node of the most frequent successor so far
+  unsigned int nodeId;    // id of the node of the word
+
+  if ((context->subtrie == 0) && (createTrieNode(trie, &context->subtrie) == NULL))
+    return NULL;
+
+  root = getNode(trie, context->subtrie);
+  node = insertWord(trie, root, getWordSpelling(trie, word), &nodeId);
+
+  // consistency
+  if (node == NULL)
+    return NULL;
+
+  node->word = word;
+
+  // ties go to the alphabetically first word, as in updateTextPrediction
+  best = (root->word != 0) ? getNode(trie, root->word) : NULL;
+
+  if ((best == NULL) || (node->count > best->count) ||
+      ((node->count == best->count) && (strcmp(getWordSpelling(trie, word), getWordSpelling(trie, best->word)) < 0)))
+    root->word = nodeId;
+
+  return node;
+}
+
+/****************************************************************
+ * Counts a pair of words in the sketch of a trie, and updates the
+ * candidates and the prediction of the first word with the new
+ * estimate of the pair.
+ *
+ * @param		trie		      trie being built with a sketch
+ * @param		previous		  id of the first word
+ * @param		word		      id of the word that follows it
+ */
+void countSketchPair (Trie* trie, unsigned int previous, unsigned int word)
+{
+  TrieSketch*        sketch = trie->sketch;   // sketch of the trie
+  TrieSuccessor*     candidates;              // candidates of the first word
+  TrieSuccessor*     entry;                   // candidate of the pair, or the smallest one
+  TrieWord*          record;                  // record of the first word
+  unsigned int*      counters[SKETCH_DEPTH];  // counter of the pair in each row
+  unsigned int       estimate = UINT_MAX;     // estimated count of the pair
+  unsigned long long pair;                    // key of the pair
+
+  // consistency
+  if ((previous == 0) || (word == 0) || !growSketchCandidates(sketch, trie->numberOfWords))
+    return;
+
+  pair = ((unsigned long long) previous << 32) | word;
+
+  // the estimate is the smallest counter of the pair, and only the counters below the new one grow
+  for (unsigned int row = 0; row < sketch->depth; row++)
+  {
+    counters[row] = &sketch->counters[(size_t) row * sketch->width + getSketchColumn(sketch, row, pair)];
+
+    if (*counters[row] < estimate)
+      estimate = *counters[row];
+  }
+
+  estimate++;
+
+  for (unsigned int row = 0; row < sketch->depth; row++)
+  {
+    if (*counters[row] < estimate)
+      *counters[row] = estimate;
+  }
+
+  // the pair updates its candidate, or takes the place of the smallest one if it is larger;
+  // as for predictions, ties go to the alphabetically first word
+  candidates = sketch->candidates + (size_t) previous * sketch->numberOfCandidates;
+  entry = candidates;
+
+  for (unsigned int i = 0; i < sketch->numberOfCandidates; i++)
+  {
+    if (candidates[i].word == word)
+    {
+      entry = &candidates[i];
+      break;
+    }
+
+    if ((candidates[i].count < entry->count) ||
+        ((candidates[i].count == entry->count) && (entry->count > 0) &&
+         (strcmp(getWordSpelling(trie, candidates[i].word), getWordSpelling(trie, entry->word)) > 0)))
+      entry = &candidates[i];
+  }
+
+  if ((entry->word != word) && ((entry->count > (int) estimate) ||
+      ((entry->count == (int) estimate) &&
+       (strcmp(getWordSpelling(trie, word), getWordSpelling(trie, entry->word)) > 0))))
+    return;
+
+  entry->word = word;
+  entry->count = estimate;
+
+  // the prediction is the largest candidate, ties going to the alphabetically first word
+  record = &trie->words[previous];
+
+  if (((int) estimate > record->predictionCount) ||
+      (((int) estimate == record->predictionCount) &&
+       (strcmp(getWordSpelling(trie, word), getWordSpelling(trie, record->prediction)) < 0)))
+  {
+    record->prediction = word;
+    record->predictionCount = estimate;
+  }
+}
+
+/****************************************************************
+ * Auxiliary function. Gets the column of a pair of words in a row
+ * of a sketch, from a hash of the pair seeded by the row.
+ *
+ * @param		sketch		    sketch of the pairs
+ * @param		row		        row of the sketch
+ * @param		pair		      ids of the two words, the first one in the upper bits
+ *
+ * @return	unsigned int  column of the pair in the row
+ */
+unsigned int getSketchColumn (TrieSketch* sketch, unsigned int row, unsigned long long pair)
+{
+  unsigned long long state = (pair + 1) * 0x9E3779B97F4A7C15ULL + row;   // key seeded by the row
+
+  return (unsigned int) (getNextRandom(&state) >> 32) & (sketch->width - 1);
+}
+
+/****************************************************************
+ * Auxiliary function. Grows the candidate table of a sketch so
+ * that it covers a number of words; new entries are unused.
+ *
+ * @param		sketch		    sketch of the pairs
+ * @param		numberOfWords	number of words to be covered
+ *
+ * @return  bool          true if the table covers them; otherwise, false
+ */
+bool growSketchCandidates (TrieSketch* sketch, unsigned int numberOfWords)
+{
+  TrieSuccessor* candidates;   // resized table
+  unsigned int   size;         // new number of words covered
+
+  if (numberOfWords <= sketch->candidateTableSize)
+    return true;
+
+  size = 2 * numberOfWords;
+  candidates = realloc(sketch->candidates, (size_t) size * sketch->numberOfCandidates * sizeof(TrieSuccessor));
+
+  // consistency
+  if (candidates == NULL)
+    return false;
+
+  memset(candidates + (size_t) sketch->candidateTableSize * sketch->numberOfCandidates, 0,
+         (size_t) (size - sketch->candidateTableSize) * sketch->numberOfCandidates * sizeof(TrieSuccessor));
+
+  sketch->candidates = candidates;
+  sketch->candidateTableSize = size;
+
+  return true;
+}
+
+/****************************************************************
+ * Auxiliary function. Turns the candidates of the sketch of a trie
+ * into its successor arrays, as packTrie does with subtries: those
+ * of each word in alphabetical order, then ranked by estimate.
+ *
+ * @param		trie		      trie built with a sketch
+ *
+ * @return  bool          true if the trie is packed; otherwise, false
+ */
+bool packSketchCandidates (Trie* trie)
+{
+  TrieSketch*    sketch = trie->sketch;   // sketch of the trie
+  TrieSuccessor  candidate;               // candidate being placed
+  unsigned int*  offsets;                 // first entry of each word
+  TrieSuccessor* successors;              // entries of all words
+  unsigned int*  ranking;                 // entries by count
+  TrieSuccessor* ranks;                   // count and position of the entries of one word
+  size_t         numberOfEntries = 0;     // candidates used by all words
+  unsigned int   numberPacked = 0,        // entries packed so far
+                 first,                   // first entry of the current word
+                 position;                // position of a candidate among the entries of its word
+
+  // counts the candidates used
+  for (size_t i = 0; i < (size_t) sketch->candidateTableSize * sketch->numberOfCandidates; i++)
+    numberOfEntries += (sketch->candidates[i].count != 0);
+
+  // consistency; entries are indexed by 32 bits
+  if (numberOfEntries >= UINT_MAX)
+    return false;
+
+  offsets = malloc((trie->numberOfWords + 1) * sizeof(unsigned int));
+  successors = malloc((numberOfEntries + 1) * sizeof(TrieSuccessor));
+  ranking = malloc((numberOfEntries + 1) * sizeof(unsigned int));
+  ranks = malloc(sketch->numberOfCandidates * sizeof(TrieSuccessor));
+
+  // consistency
+  if ((offsets == NULL) || (successors == NULL) || (ranking == NULL) || (ranks == NULL))
+  {
+    free(offsets);
+    free(successors);
+    free(ranking);
+    free(ranks);
+
+    return false;
+  }
+
+  offsets[0] = 0;
+
+  for (unsigned int i = 0; i < trie->numberOfWords; i++)
+  {
+    first = numberPacked;
+
+    // inserts the candidates used in alphabetical order; there are only a few
+    for (unsigned int j = 0; (i < sketch->candidateTableSize) && (j < sketch->numberOfCandidates); j++)
+    {
+      candidate = sketch->candidates[(size_t) i * sketch->numberOfCandidates + j];
+
+      if (candidate.count == 0)
+        continue;
+
+      for (position = numberPacked; (position > first) &&
+           (strcmp(getWordSpelling(trie, successors[position - 1].word), getWordSpelling(trie, candidate.word)) > 0);
+           position--)
+        successors[position] = successors[position - 1];
+
+      successors[position] = candidate;
+      numberPacked++;
+    }
+
+    offsets[i + 1] = numberPacked;
+
+    // the empty subtrie of a word followed by a word without letters only stays if nothing else followed it
+    if (numberPacked > first)
+      getNode(trie, trie->words[i].node)->subtrie = 0;
+
+    // ranks the entries by estimate; equal estimates stay in alphabetical order
+    for (unsigned int j = first; j < numberPacked; j++)
+    {
+      ranks[j - first].word = j;
+      ranks[j - first].count = successors[j].count;
+    }
+
+    qsort(ranks, numberPacked - first, sizeof(TrieSuccessor), compareSuccessorRanks);
+
+    for (unsigned int j = first; j < numberPacked; j++)
+      ranking[j] = ranks[j - first].word;
+  }
+
+  free(ranks);
+
+  trie->successorOffsets = offsets;
+  trie->successors = successors;
+  trie->successorRanking = ranking;
+  trie->numberOfSuccessors = numberPacked;
+
+  // the main trie is laid out as for a packed trie
+  freezeTrie(trie);
+
+  return true;
+}
+
+/****************************************************************
+ * Inserts a word into trie node. Returns last node.
+ *
+ * @param		trie		      trie that owns the new nodes
+ * @param		node		      node of the trie
+ * @param		word		      word to be inserted in the trie
+ * @param		id		        receives the id of the last node, if not NULL
+ *
+ * @return  TrieNode*     node of the trie that contains the last letter of the word
+ */
+TrieNode* insertWord (Trie* trie, TrieNode* node, char* word, unsigned int* id)
+{
+  // consistency
+  if ((node == NULL) || (word == NULL) || (*word == '\0'))
+    return NULL;
+
+  // descends one letter at a time, creating missing nodes
+  for (; *word != '\0'; word++)
+  {
+    node = getOrCreateChild(trie, node, *word, id);
+    COUNT_STAT(insertVisits, 1);
+
+    // consistency
+    if (node == NULL)
+      return NULL;
+  }
+
+  // increments word count
+  node->count++;
+
+  // returns last node of the word
+  return node;
+}
+
+/****************************************************************
+ * Receives and runs command from file. Answers are collected in
+ * an output buffer, which is written whenever it fills up.
+ *
+ * @param		trie		      trie to be queried
+ * @param		filename		  name of the file with the commands
+ */
+void runFileCommands (Trie* trie, char* filename)
+{
+  FILE*      file;                       // file with commands
+  char       command[MAX_CHARACTERS];    // command
+  TrieOutput output = {0};               // answers not yet written
+
+  if ((trie == NULL) || (filename == NULL))
+    return;
+
+  // opens file
+  file = fopen(filename, "r");
+
+  // consistency
+  if (file == NULL)
+  {
+    printf("\nError: Unable to open file %s.\n\n", filename);
+    return;
+  }
+
+  // reads file line-by-line
+  while (fgets(command, MAX_CHARACTERS, file) != NULL)
+  {
+    runCommand(trie, command, &output);
+
+    if (output.length >= OUTPUT_FLUSH_SIZE)
+      flushOutput(&output);
+  }
+
+  flushOutput(&output);
+  free(output.text);
+
+  // closes file
+  fclose(file);
+}
+
+/****************************************************************
+ * Runs all commands of a file as one batch. A command seen before
+ * is answered by copying its earlier answer, and the whole output
+ * is written once, at the end. The output is the same as
+ * runFileCommands'.
+ *
+ * @param		trie		      trie to be queried
+ * @param		filename		  name of the file with the commands
+ */
+void runBatchCommands (Trie* trie, char* filename)
+{
+  runParallelCommands(trie, filename, 1);
+}
+
+/****************************************************************
+ * Runs the commands of a file on several threads. The file is
+ * split into one chunk of lines per thread, each chunk is answered
+ * as a batch into an output of its own, and the outputs are then
+ * written in the order of the chunks, so the output is the same
+ * as runFileCommands'. A file that updates the trie is answered
+ * on one thread.
+ *
+ * @param		trie		          trie to be queried
+ * @param		filename		      name of the file with the commands
+ * @param		numberOfThreads		number of threads, and of chunks
+ */
+void runParallelCommands (Trie* trie, char* filename, int numberOfThreads)
+{
+  TrieQueryTask*  tasks;      // one task per chunk
+  char*           text;       // contents of the file
+  size_t          size;       // size of the file
+
+  // consistency
+  if ((trie == NULL) || (filename == NULL) || (numberOfThreads < 1))
+    return;
+
+  text = mapFile(filename, &size, MADV_SEQUENTIAL);
+
+  // consistency; an empty file has no commands
+  if (text == NULL)
+    return;
+
+  // commands after an update must see it, so a file with updates is answered in order
+  if (hasUpdateCommands(text, size))
+    numberOfThreads = 1;
+
+  tasks = calloc(numberOfThreads, sizeof(TrieQueryTask));
+
+  // consistency
+  if (tasks == NULL)
+  {
+    munmap(text, size);
+    return;
+  }
+
+  runQueryTasks(trie, text, size, tasks, numberOfThreads);
+
+  // writes answers in the order of the commands
+  for (int i = 0; i < numberOfThreads; i++)
+  {
+    flushOutput(&tasks[i].output);
+    free(tasks[i].output.text);
+  }
+
+  free(tasks);
+  munmap(text, size);
+}
+
+/****************************************************************
+ * Auxiliary function. Tells whether a command file updates the
+ * trie, that is, whether a line starts with '+'.
+ *
+ * @param		text		      commands
+ * @param		size		      number of characters of the commands
+ *
+ * @return  bool          true if a line is an update; otherwise, false
+ */
+bool hasUpdateCommands (char* text, size_t size)
+{
+  char* line = text;    // start of the current line
+  char* newline;        // newline that ends it
+
+  while (line < text + size)
+  {
+    if (*line == '+')
+      return true;
+
+    newline = memchr(line, '\n', text + size - line);
+
+    if (newline == NULL)
+      break;
+
+    line = newline + 1;
+  }
+
+  return false;
+}
+
+/****************************************************************
+ * Auxiliary function. Splits commands into chunks of lines and
+ * answers each chunk on its own thread.
+ *
+ * @param		trie		          trie to be queried
+ * @param		text		          commands
+ * @param		size		          number of characters of the commands
+ * @param		tasks		          one task per thread, whose outputs are filled
+ * @param		numberOfThreads		number of threads, and of chunks
+ */
+void runQueryTasks (Trie* trie, char* text, size_t size, TrieQueryTask* tasks, int numberOfThreads)
+{
+  pthread_t*  threads;    // one thread per task
+  bool*       started;    // whether each task got its own thread
+  char*       newline;    // newline that ends a chunk
+  size_t      start = 0,  // start of the current chunk
+              end;        // end of the current chunk
+
+  // splits commands right after the first newline past each even share
+  for (int i = 0; i < numberOfThreads; i++)
+  {
+    end = size * (i + 1) / numberOfThreads;
+
+    if (end < start)
+      end = start;
+
+    newline = memchr(text + end, '\n', size - end);
+    end = ((i == numberOfThreads - 1) || (newline == NULL)) ? size : (size_t) (newline - text) + 1;
+
+    tasks[i].trie = trie;
+    tasks[i].text = text + start;
+    tasks[i].length = end - start;
+
+    start = end;
+  }
+
+  threads = calloc(numberOfThreads, sizeof(pthread_t));
+  started = calloc(numberOfThreads, sizeof(bool));
+
+  // answers each chunk; the first chunk runs on this thread, as well as chunks without a thread
+  for (int i = 1; (i < numberOfThreads) && (threads != NULL) && (started != NULL); i++)
+    started[i] = (pthread_create(&threads[i], NULL, runQueryTask, &tasks[i]) == 0);
+
+  runQueryTask(&tasks[0]);
+
+  for (int i = 1; i < numberOfThreads; i++)
+  {
+    if ((started != NULL) && started[i])
+      pthread_join(threads[i], NULL);
+    else
+      runQueryTask(&tasks[i]);
+  }
+
+  free(threads);
+  free(started);
+}
+
+/****************************************************************
+ * Auxiliary function. Answers a chunk of commands as a batch. The
+ * chunk is split into lines the same way fgets splits a file.
+ *
+ * @param		task		      task with the chunk
+ *
+ * @return	void*         NULL, as required by pthread_create
+ */
+void* runQueryTask (void* task)
+{
+  TrieQueryTask* queryTask = task;          // task with the chunk
+  TrieQueryMemo  memo = {0};                // answers by command
+  char           command[MAX_CHARACTERS];   // command
+  char*          text = queryTask->text;    // start of the command
+  char*          end;                       // newline ending the command
+  size_t         remaining,                 // characters left in the chunk
+                 length;                    // number of characters of the command
+
+  for (remaining = queryTask->length; remaining > 0; remaining -= length)
+  {
+    // a command ends at a newline, or where the fgets buffer would be full
+    length = (remaining < MAX_CHARACTERS - 1) ? remaining : MAX_CHARACTERS - 1;
+    end = memchr(text, '\n', length);
+
+    if (end != NULL)
+      length = end - text + 1;
+
+    memcpy(command, text, length);
+    command[length] = '\0';
+    text += length;
+
+    runMemoizedCommand(queryTask->trie, command, &memo, &queryTask->output);
+    queryTask->numberOfCommands++;
+  }
+
+  // deallocates memory
+  free(memo.entries);
+  free(memo.keys);
+
+  return NULL;
+}
+
+/****************************************************************
+ * Serves queries on a Unix domain socket until interrupted. A
+ * request is one line, as in a command file, and its answer is the
+ * output of the command, preceded by a line with its length in
+ * characters. A client can send any number of requests without
+ * waiting for the answers, which come back in order. Each thread
+ * runs an event loop over the connections it accepted, so requests
+ * are answered in parallel; an update, '+', waits for the requests
+ * in progress and runs alone.
+ *
+ * @param		trie		          trie to be queried
+ * @param		socketPath		    path of the socket, replaced if it exists
+ * @param		numberOfThreads		number of threads serving connections
+ *
+ * @return  bool          true if the server ran until interrupted; otherwise, false
+ */
+bool serveTrie (Trie* trie, char* socketPath, int numberOfThreads)
+{
+  struct sockaddr_un address = {0};    // address of the socket
+  struct sigaction   action = {0};     // handler of the signals that stop the server
+  pthread_rwlock_t   lock;             // lock taken alone by updates
+  TrieServerTask*    tasks;            // one event loop per thread
+  pthread_t*         threads;          // one thread per event loop
+  bool*              started;          // whether each thread was started
+  int                listener;         // listening socket
+  long               numberOfRequests = 0;   // requests answered by all threads
+
+  // consistency
+  if ((trie == NULL) || (socketPath == NULL) || (strlen(socketPath) >= sizeof(address.sun_path)))
+    return false;
+
+  if (numberOfThreads < 1)
+    numberOfThreads = 1;
+
+  address.sun_family = AF_UNIX;
+  strcpy(address.sun_path, socketPath);
+  unlink(socketPath);
+
+  listener = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK, 0);
+
+  // consistency
+  if ((listener < 0) || (bind(listener, (struct sockaddr*) &address, sizeof(address)) != 0)
+      || (listen(listener, SOMAXCONN) != 0))
+  {
+    printf("\nError: Unable to listen on %s.\n\n", socketPath);
+
+    if (listener >= 0)
+      close(listener);
+
+    return false;
+  }
+
+  tasks = calloc(numberOfThreads, sizeof(TrieServerTask));
+  threads = calloc(numberOfThreads, sizeof(pthread_t));
+  started = calloc(numberOfThreads, sizeof(bool));
+
+  // consistency
+  if ((tasks == NULL) || (threads == NULL) || (started == NULL))
+  {
+    free(tasks);
+    free(threads);
+    free(started);
+    close(listener);
+    unlink(socketPath);
+    return false;
+  }
+
+  // stops on interruption; clients that leave are seen by send, with no SIGPIPE
+  serverStopping = 0;
+  action.sa_handler = stopServer;
+  sigaction(SIGINT, &action, NULL);
+  sigaction(SIGTERM, &action, NULL);
+
+  pthread_rwlock_init(&lock, NULL);
+
+  for (int i = 0; i < numberOfThreads; i++)
+  {
+    tasks[i].trie = trie;
+    tasks[i].lock = &lock;
+    tasks[i].listener = listener;
+    started[i] = (pthread_create(&threads[i], NULL, runServerTask, &tasks[i]) == 0);
+  }
+
+  printf("Serving %s on %d threads\n", socketPath, numberOfThreads);
+  fflush(stdout);
+
+  for (int i = 0; i < numberOfThreads; i++)
+  {
+    if (started[i])
+      pthread_join(threads[i], NULL);
+
+    numberOfRequests += tasks[i].numberOfRequests;
+    free(tasks[i].answer.text);
+  }
+
+  printf("Answered %ld requests\n", numberOfRequests);
+
+  // deallocates memory
+  pthread_rwlock_destroy(&lock);
+  close(listener);
+  unlink(socketPath);
+  free(tasks);
+  free(threads);
+  free(started);
+
+  return true;
+}
+
+/****************************************************************
+ * Auxiliary function. Asks the query server to stop, on a signal.
+ *
+ * @param		signal		    signal received
+ */
+void stopServer (int signal)
+{
+  (void) signal;
+  serverStopping = 1;
+}
+
+/****************************************************************
+ * Auxiliary function. Runs the event loop of one thread of the
+ * query server. All threads wait on the listening socket, and
+ * the one that accepts a connection serves it until it closes.
+ *
+ * @param		task		      event loop of the thread
+ *
+ * @return	void*         NULL, as required by pthread_create
+ */
+void* runServerTask (void* task)
+{
+  TrieServerTask*    serverTask = task;              // event loop of this thread
+  TrieConnection*    connections = NULL;             // connections of this thread
+  TrieConnection*    connection;                     // connection with an event
+  struct epoll_event events[SERVER_EVENTS];          // events of one wait
+  struct epoll_event event = {0};                    // listening socket, woken in one thread at a time
+  int                poll,                           // event queue of this thread
+                     numberOfEvents;                 // events of one wait
+
+  poll = epoll_create1(0);
+  event.events = EPOLLIN | EPOLLEXCLUSIVE;
+  event.data.ptr = NULL;
+
+  // consistency
+  if ((poll < 0) || (epoll_ctl(poll, EPOLL_CTL_ADD, serverTask->listener, &event) != 0))
+  {
+    if (poll >= 0)
+      close(poll);
+
+    return NULL;
+  }
+
+  // wakes up now and then to see whether the server stops
+  while (!serverStopping)
+  {
+    numberOfEvents = epoll_wait(poll, events, SERVER_EVENTS, SERVER_WAIT_MILLISECONDS);
+
+    for (int i = 0; i < numberOfEvents; i++)
+    {
+      connection = events[i].data.ptr;
+
+      if (connection == NULL)
+        acceptConnections(serverTask, poll, &connections);
+      else if (((events[i].events & (EPOLLERR | EPOLLHUP)) != 0) && !(events[i].events & EPOLLIN))
+        closeConnection(connection, &connections);
+      else if (!serveConnection(serverTask, poll, connection))
+        closeConnection(connection, &connections);
+    }
+  }
+
+  // deallocates memory
+  while (connections != NULL)
+    closeConnection(connections, &connections);
+
+  close(poll);
+
+  return NULL;
+}
+
+/****************************************************************
+ * Auxiliary function. Accepts the connections waiting on the
+ * listening socket, and adds them to the event queue of a thread.
+ * Other threads may accept some of them first.
+ *
+ * @param		task		      event loop of the thread
+ * @param		poll		      event queue of the thread
+ * @param		connections		connections of the thread, to which new ones are added
+ *
+ * @return  bool          true if a connection was accepted; otherwise, false
+ */
+bool acceptConnections (TrieServerTask* task, int poll, TrieConnection** connections)
+{
+  TrieConnection*    connection;       // new connection
+  struct epoll_event event = {0};      // requests of the new connection
+  int                client;           // socket of the new connection
+  bool               accepted = false; // whether a connection was accepted
+
+  while ((client = accept(task->listener, NULL, NULL)) >= 0)
+  {
+    connection = calloc(1, sizeof(TrieConnection));
+    event.events = EPOLLIN;
+    event.data.ptr = connection;
+
+    // consistency
+    if ((connection == NULL) || (fcntl(client, F_SETFL, O_NONBLOCK) != 0)
+        || (epoll_ctl(poll, EPOLL_CTL_ADD, client, &event) != 0))
+    {
+      free(connection);
+      close(client);
+      continue;
+    }
+
+    connection->socket = client;
+    connection->events = EPOLLIN;
+    connection->next = *connections;
+
+    if (*connections != NULL)
+      (*connections)->previous = connection;
+
+    *connections = connection;
+    accepted = true;
+  }
+
+  return accepted;
+}
+
+/****************************************************************
+ * Auxiliary function. Receives the requests of a connection,
+ * answers the complete ones and sends as much of the answers as
+ * the socket takes. A connection stops reading while too many
+ * answers wait to be sent, and waits for the socket to take them.
+ *
+ * @param		task		      event loop of the thread
+ * @param		poll		      event queue of the thread
+ * @param		connection		connection with an event
+ *
+ * @return  bool          false if the connection is over; otherwise, true
+ */
+bool serveConnection (TrieServerTask* task, int poll, TrieConnection* connection)
+{
+  struct epoll_event event = {0};    // events the connection waits for next
+  ssize_t            transferred;    // characters received or sent
+  size_t             pending;        // characters of the answers not yet sent
+  char*              input;          // grown input
+  bool               blocked;        // whether requests wait for answers to be sent
+
+  pending = connection->output.length - connection->outputSent;
+
+  if (!connection->closing && (pending < SERVER_BACKLOG_SIZE))
+  {
+    // room for one more block of requests
+    if (connection->inputSize - connection->inputLength < MAX_CHARACTERS)
+    {
+      input = realloc(connection->input, connection->inputSize + OUTPUT_FLUSH_SIZE);
+
+      // consistency
+      if (input == NULL)
+        return false;
+
+      connection->input = input;
+      connection->inputSize += OUTPUT_FLUSH_SIZE;
+    }
+
+    transferred = recv(connection->socket, connection->input + connection->inputLength,
+                       connection->inputSize - connection->inputLength, 0);
+
+    // the client sent all its requests; the last ones are still answered
+    if (transferred == 0)
+      connection->closing = true;
+    else if (transferred > 0)
+      connection->inputLength += transferred;
+    else if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+      return false;
+  }
+
+  // answers more requests as long as the socket takes all answers
+  do
+  {
+    blocked = answerRequests(task, connection);
+    pending = connection->output.length - connection->outputSent;
+
+    if (pending > 0)
+    {
+      transferred = send(connection->socket, connection->output.text + connection->outputSent, pending,
+                         MSG_NOSIGNAL);
+
+      if (transferred > 0)
+        connection->outputSent += transferred;
+      else if ((transferred < 0) && (errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR))
+        return false;
+    }
+
+    // all answers sent; the output is reused from the start
+    if (connection->outputSent == connection->output.length)
+    {
+      connection->output.length = 0;
+      connection->outputSent = 0;
+    }
+  } while (blocked && (connection->output.length == 0));
+
+  pending = connection->output.length - connection->outputSent;
+
+  if (connection->closing && (pending == 0) && (connection->inputLength == 0))
+    return false;
+
+  // reads while answers can be queued, and waits for room to send the rest
+  event.events = ((!connection->closing && (pending < SERVER_BACKLOG_SIZE)) ? EPOLLIN : 0)
+                 | ((pending > 0) ? EPOLLOUT : 0);
+  event.data.ptr = connection;
+
+  if (event.events != connection->events)
+  {
+    // consistency
+    if (epoll_ctl(poll, EPOLL_CTL_MOD, connection->socket, &event) != 0)
+      return false;
+
+    connection->events = event.events;
+  }
+
+  return true;
+}
+
+/****************************************************************
+ * Auxiliary function. Answers the complete requests received on
+ * a connection, in order, until too many answers wait to be sent.
+ * Requests are split into lines the same way fgets splits a file,
+ * and each answer is preceded by a line with its length.
+ *
+ * @param		task		      event loop of the thread
+ * @param		connection		connection with requests
+ *
+ * @return  bool          true if complete requests wait for answers to be sent; otherwise, false
+ */
+bool answerRequests (TrieServerTask* task, TrieConnection* connection)
+{
+  char   command[MAX_CHARACTERS];       // command
+  char*  text = connection->input;      // start of the command
+  char*  end;                           // newline ending the command
+  size_t remaining = connection->inputLength,   // characters received and not answered
+         length;                        // number of characters of the command
+
+  while ((remaining > 0) && (connection->output.length - connection->outputSent < SERVER_BACKLOG_SIZE))
+  {
+    // a command ends at a newline, or where the fgets buffer would be full
+    length = (remaining < MAX_CHARACTERS - 1) ? remaining : MAX_CHARACTERS - 1;
+    end = memchr(text, '\n', length);
+
+    if (end != NULL)
+      length = end - text + 1;
+    else if ((length < MAX_CHARACTERS - 1) && !connection->closing)
+      break;
+
+    memcpy(command, text, length);
+    command[length] = '\0';
+    text += length;
+    remaining -= length;
+
+    // updates run alone
+    if (command[0] == '+')
+      pthread_rwlock_wrlock(task->lock);
+    else
+      pthread_rwlock_rdlock(task->lock);
+
+    runCommand(task->trie, command, &task->answer);
+    pthread_rwlock_unlock(task->lock);
+
+    writeOutputFormat(&connection->output, "%zu\n", task->answer.length);
+    writeOutput(&connection->output, task->answer.text, task->answer.length);
+    task->answer.length = 0;
+    task->numberOfRequests++;
+  }
+
+  // keeps the requests not answered for later
+  memmove(connection->input, text, remaining);
+  connection->inputLength = remaining;
+
+  return (remaining > 0) && (connection->output.length - connection->outputSent >= SERVER_BACKLOG_SIZE);
+}
+
+/****************************************************************
+ * Auxiliary function. Closes a connection of the query server and
+ * removes it from the connections of its thread.
+ *
+ * @param		connection		connection to be closed
+ * @param		connections		connections of the thread
+ */
+void closeConnection (TrieConnection* connection, TrieConnection** connections)
+{
+  if (connection->previous != NULL)
+    connection->previous->next = connection->next;
+  else
+    *connections = connection->next;
+
+  if (connection->next != NULL)
+    connection->next->previous = connection->previous;
+
+  // closing the socket also removes it from the event queue
+  close(connection->socket);
+  free(connection->input);
+  free(connection->output.text);
+  free(connection);
+}
+
+/****************************************************************
+ * Runs one command of a command file.
+ *
+ * @param		trie		      trie to be queried
+ * @param		command		    line of the command file
+ * @param		output		    output the answer is written to
+ */
+void runCommand (Trie* trie, char* command, TrieOutput* output)
+{
+#ifdef TRIE_STATS
+  struct timespec start;    // start time of the command
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+#endif
+
+  // checks if a command was received
+  if (command[0] == '\0')
+    return;
+
+  if (command[0] == '!')
+  {
+    // passes root of trie to be printed
+    eventCommand1(trie, output);
+  }
+  else if (command[0] == '@')
+  {
+    // passes command without @: Contains string and number
+    eventCommand2(trie, (command[1] == '\0') ? command + 1 : command + 2, output);
+
+    // fixes display for multiple calls to text prediction command
+    writeOutput(output, "\n", 1);
+  }
+  else if (command[0] == '#')
+  {
+    // prints shape of the trie and counters
+    eventCommand4(trie, output);
+  }
+  else if (command[0] == '?')
+  {
+    // passes command without ?: Contains prefix and number
+    eventCommand5(trie, (command[1] == '\0') ? command + 1 : command + 2, output);
+  }
+  else if ((command[0] == '>') || (command[0] == '<'))
+  {
+    // passes command without > or <: Contains string and number
+    eventCommand6(trie, (command[1] == '\0') ? command + 1 : command + 2, command[0] == '<', output);
+  }
+  else if (command[0] == '+')
+  {
+    // passes command without +: Contains phrase to be inserted
+    eventCommand7(trie, command + 1, output);
+  }
+  else
+  {
+    // passes string to be searched
+    eventCommand3(trie, command, output);
+  }
+
+#ifdef TRIE_STATS
+  recordCommandLatency(getCommandKind(command), &start);
+#endif
+}
+
+/****************************************************************
+ * Runs one command of a batch, unless an equivalent command ran
+ * before. The trie print ignores what follows the '!', and a
+ * prediction, completion or bounded listing depends only on its
+ * word and count, so those are normalized; a lookup echoes its
+ * line, so the line is its key. An update makes every earlier
+ * answer stale, so it empties the memo.
+ *
+ * @param		trie		      trie to be queried
+ * @param		command		    line of the command file
+ * @param		memo		      answers of the commands run so far
+ * @param		output		    output of the batch
+ */
+void runMemoizedCommand (Trie* trie, char* command, TrieQueryMemo* memo, TrieOutput* output)
+{
+  char   key[MAX_CHARACTERS_PER_WORD + 16];   // normalized prediction command
+  char   word[MAX_CHARACTERS_PER_WORD];       // word of a prediction command
+  char*  memoKey;                             // key of the command in the memo
+  int    numberOfWords;                       // count of a prediction command
+  size_t offset,                              // offset of the answer in the output
+         length;                              // length of the answer
+
+  // consistency; statistics change from one command to the next
+  if (command[0] == '\0')
+    return;
+
+  if (command[0] == '#')
+  {
+    runCommand(trie, command, output);
+    return;
+  }
+
+  if (command[0] == '+')
+  {
+    runCommand(trie, command, output);
+    clearQueryMemo(memo);
+    return;
+  }
+
+  if (command[0] == '!')
+  {
+    memoKey = "!";
+  }
+  else if ((command[0] == '@') || (command[0] == '?') || (command[0] == '>') || (command[0] == '<'))
+  {
+    numberOfWords = parsePredictionCommand(trie, (command[1] == '\0') ? command + 1 : command + 2, word);
+    sprintf(key, "%c%d %s", command[0], numberOfWords, word);
+    memoKey = key;
+  }
+  else
+  {
+    memoKey = command;
+  }
+
+  // copies earlier answer; the space is reserved first, since the copy reads from the output itself
+  if (findQueryMemo(memo, memoKey, &offset, &length))
+  {
+    COUNT_STAT(memoHits, 1);
+
+    if (reserveOutput(output, length))
+      writeOutput(output, output->text + offset, length);
+
+    return;
+  }
+
+  offset = output->length;
+  runCommand(trie, command, output);
+  addQueryMemo(memo, memoKey, offset, output->length - offset);
+}
+
+/****************************************************************
+ * Executes command to print trie.
+ *
+ * @param		trie		      trie to be printed
+ * @param		output		    output the words are written to
+ */
+void eventCommand1 (Trie* trie, TrieOutput* output)
+{
+  // prints trie with defined format
+  printTrieSimpleFormat(trie, trie->root, output);
+}
+
+/****************************************************************
+ * Executes command for text prediction in trie.
+ *
+ * @param		trie	        trie to be queried
+ * @param		phrase		    string with words
+ * @param		output		    output the prediction is written to
+ */
+void eventCommand2 (Trie* trie, char* phrase, TrieOutput* output)
+{
+  const TrieNode* node = NULL;                      // node of the trie
+  int             numberOfWords;                    // number of words
+  char            word[MAX_CHARACTERS_PER_WORD];    // word of the command
+
+  // consistency
+  if ((trie == NULL) || (phrase == NULL))
+    return;
+
+  numberOfWords = parsePredictionCommand(trie, phrase, word);
+
+  writeOutputString(output, word);
+
+  // gets node with given word
+  node = getTrieNode(trie, trie->root, word);
+
+  // consistency
+  if (node == NULL)
+    return;
+
+  else if (!hasSuccessors(trie, node))
+    return;
+
+  else if (trie->beamWidth > 0)
+    getBeamPrediction(trie, node, numberOfWords, output);
+
+  else if (trie->sampleSize > 0)
+    getSampledPrediction(trie, node, numberOfWords, output);
+
+  else
+    getTextPrediction (trie, node, numberOfWords, output);
+}
+
+/****************************************************************
+ * Auxiliary function. Splits a prediction command into its word,
+ * made of all its letters, and its count, made of all its digits.
+ * In the bytes alphabet digits are letters too, so the count is
+ * the number that ends the command and the word is made of the
+ * letters before it.
+ *
+ * @param		trie	        trie whose alphabet the word is spelled in
+ * @param		phrase		    string with word and number
+ * @param		word		      buffer to store the word
+ *
+ * @return	int           number of words to be predicted
+ */
+int parsePredictionCommand (Trie* trie, char* phrase, char* word)
+{
+  int   wordIndex = 0,                      // index of the word
+        numberIndex = 0;                    // index of the number
+  char  number[MAX_CHARACTERS_PER_WORD];    // number of the command
+  char* end = NULL;                         // start of the number that ends the command, in the bytes alphabet
+
+  if (trie->alphabet == TRIE_ALPHABET_BYTES)
+  {
+    end = phrase + strlen(phrase);
+
+    while ((end > phrase) && !isLetter(end[-1], TRIE_ALPHABET_BYTES))
+      end--;
+
+    while ((end > phrase) && isdigit((unsigned char) end[-1]))
+      end--;
+  }
+
+  // removes word and number from phrase
+  for (; *phrase != '\0'; phrase++)
+  {
+    if ((end != NULL) && (phrase < end))
+    {
+      if (isLetter(*phrase, TRIE_ALPHABET_BYTES) && (wordIndex < MAX_CHARACTERS_PER_WORD - 1))
+        word[wordIndex++] = *phrase;
+    }
+    else if (isalpha(*phrase) && (wordIndex < MAX_CHARACTERS_PER_WORD - 1))
+    {
+      word[wordIndex] = *phrase;
+      wordIndex++;
+    }
+    else if (isdigit(*phrase) && (numberIndex < MAX_CHARACTERS_PER_WORD - 1))
+    {
+      number[numberIndex] = *phrase;
+      numberIndex++;
+    }
+  }
+
+  // adding end-of-line character
+  word[wordIndex] = '\0';
+  number[numberIndex] = '\0';
+
+  // converting string to integer
+  return atoi(number);
+}
+
+/****************************************************************
+ * Auxiliary function. Tells the kind of a command, as counted by
+ * the instrumentation layer.
+ *
+ * @param		command		    line of the command file
+ *
+ * @return	int           0 for a trie print, 1 for a prediction, 2 for a word
+ *                        search, 3 for statistics, 4 for a completion, 5
+ *                        for a bounded successor listing and 6 for an update
+ */
+int getCommandKind (char* command)
+{
+  switch (command[0])
+  {
+    case '!':
+      return 0;
+
+    case '@':
+      return 1;
+
+    case '#':
+      return 3;
+
+    case '?':
+      return 4;
+
+    case '>':
+    case '<':
+      return 5;
+
+    case '+':
+      return 6;
+
+    default:
+      return 2;
+  }
+}
+
+/****************************************************************
+ * Executes command for word search in trie.
+ *
+ * @param		trie	        trie to be queried
+ * @param		word		      string with word
+ * @param		output		    output the successors are written to
+ */
+void eventCommand3 (Trie* trie, char* word, TrieOutput* output)
+{
+  const TrieNode* node = NULL;    // node of the trie
+  char            successor[MAX_CHARACTERS_PER_WORD + 2] = "- ";   // successor, after the hyphen
+
+  // consistency
+  if ((trie == NULL) || (word == NULL))
+    return;
+
+  // prints received string command on screen
+  writeOutputString(output, word);
+
+  // searches for word in trie
+  node = getTrieNode(trie, trie->root, word);
+
+  // checks if word was found in root trie. If not, exit
+  if (node == NULL)
+  {
+    writeOutputString(output, "(INVALID STRING)\n");
+
+    // if node is null, it has no subtrie
+    return;
+  }
+
+  // checks if word has a subtrie
+  if (!hasSuccessors(trie, node))
+    writeOutputString(output, "(EMPTY)\n");
+
+  // prints the entries of a packed trie
+  else if (trie->successorOffsets != NULL)
+    writePackedSuccessors(trie, node->word, output);
+
+  // uses recursive call with hyphen as root
+  else
+    printTrieNodeWordsSimpleFormat(trie, getNode(trie, node->subtrie), successor, 2, output);
+}
+
+/****************************************************************
+ * Executes command to print statistics: the shape of the trie and
+ * the memory it uses, followed by the counters and latencies of
+ * the instrumentation layer when it is compiled in.
+ *
+ * @param		trie		      trie to be described
+ * @param		output		    output the statistics are written to
+ */
+void eventCommand4 (Trie* trie, TrieOutput* output)
+{
+  TrieNode*    node;                      // node of the trie
+  long         mainNodes,                 // nodes of the main trie
+               freeSlots = 0,             // positions of a frozen trie left without a node
+               subtrieNodes = 0,          // nodes of all subtries
+               numberOfSubtries = 0,      // words with a subtrie
+               numberOfWords = 0,         // words of the main trie
+               successors,                // words of one subtrie
+               maxSuccessors = 0,         // words of the largest subtrie
+               innerNodes = 0,            // nodes with children
+               edges = 0,                 // links from a node to a child
+               fanout,                    // children of one node
+               maxFanout = 0;             // children of the widest node
+  unsigned int busiestWord = 0,           // word with the most successors
+               longestWord = 0;           // word with the longest spelling
+  size_t       length,                    // length of a spelling
+               maxLength = 0,             // length of the longest spelling
+               successorBytes = 0,        // size of the successor arrays of a packed trie
+               labelBytes = 0;            // size of the labels of a compressed trie
+
+  // consistency
+  if ((trie == NULL) || (output == NULL))
+    return;
+
+  if (trie->labels != NULL)
+    labelBytes = trie->numberOfNodes * sizeof(unsigned int) + trie->labelTextLength;
+
+  if (trie->successorOffsets != NULL)
+    successorBytes = (trie->numberOfWords + 1) * sizeof(unsigned int) +
+                     trie->numberOfSuccessors * (sizeof(TrieSuccessor) + sizeof(unsigned int));
+
+  mainNodes = countTrieNodes(trie, trie->root, &numberOfWords);
+
+  // subtrie sizes, and the words with the most successors and the longest spelling
+  for (unsigned int i = 1; i < trie->numberOfWords; i++)
+  {
+    node = getNode(trie, trie->words[i].node);
+    length = strlen(getWordSpelling(trie, i));
+
+    if (length > maxLength)
+    {
+      maxLength = length;
+      longestWord = i;
+    }
+
+    if (!hasSuccessors(trie, node))
+      continue;
+
+    // a packed trie has entries instead of subtrie nodes
+    successors = 0;
+
+    if (trie->successorOffsets != NULL)
+      successors = trie->successorOffsets[i + 1] - trie->successorOffsets[i];
+    else
+      subtrieNodes += countTrieNodes(trie, getNode(trie, node->subtrie), &successors);
+
+    numberOfSubtries++;
+
+    if (successors > maxSuccessors)
+    {
+      maxSuccessors = successors;
+      busiestWord = i;
+    }
+  }
+
+  // fanout of the nodes with children; ids are dense
+  for (long id = 0; id < trie->numberOfNodes; id++)
+  {
+    node = getNode(trie, id);
+    fanout = 0;
+
+    for (TrieNode* child = getFirstChild(trie, node); child != NULL; child = getNextSibling(trie, child))
+      fanout++;
+
+    if (fanout > 0)
+      innerNodes++;
+
+    // every node but a root has a letter, and every root has children
+    if ((id != 0) && (node->letter == 0) && (fanout == 0))
+      freeSlots++;
+
+    if (fanout > maxFanout)
+      maxFanout = fanout;
+
+    edges += fanout;
+  }
+
+  writeOutputFormat(output, "nodes.............: %ld \n", trie->numberOfNodes - freeSlots);
+  writeOutputFormat(output, "frozen............: %s \n", trie->frozen ? "yes" : "no");
+  writeOutputFormat(output, "compressed........: %s \n", (trie->labels != NULL) ? "yes" : "no");
+  writeOutputFormat(output, "free slots........: %ld \n", freeSlots);
+  writeOutputFormat(output, "main trie nodes...: %ld \n", mainNodes);
+  writeOutputFormat(output, "subtrie nodes.....: %ld \n", subtrieNodes);
+  writeOutputFormat(output, "subtries..........: %ld \n", numberOfSubtries);
+  writeOutputFormat(output, "context nodes.....: %ld \n", trie->numberOfNodes - freeSlots - mainNodes - subtrieNodes);
+  writeOutputFormat(output, "order.............: %d \n", trie->order);
+  writeOutputFormat(output, "alphabet..........: %s \n", (trie->alphabet == TRIE_ALPHABET_BYTES) ? "bytes" : "letters");
+  writeOutputFormat(output, "words.............: %ld \n", numberOfWords);
+  writeOutputFormat(output, "average fanout....: %.2f \n", (innerNodes > 0) ? (double) edges / innerNodes : 0.0);
+  writeOutputFormat(output, "maximum fanout....: %ld \n", maxFanout);
+  writeOutputFormat(output, "node bytes........: %ld \n", trie->numberOfNodes * (long) sizeof(TrieNode));
+  writeOutputFormat(output, "packed successors.: %u \n", trie->numberOfSuccessors);
+  writeOutputFormat(output, "successor bytes...: %zu \n", successorBytes);
+  writeOutputFormat(output, "label bytes.......: %zu \n", labelBytes);
+  writeOutputFormat(output, "allocated bytes...: %zu \n", getTrieBytes(trie));
+  writeOutputFormat(output, "longest word......: %s (%zu) \n", getWordSpelling(trie, longestWord), maxLength);
+  writeOutputFormat(output, "most successors...: %s (%ld) \n", getWordSpelling(trie, busiestWord), maxSuccessors);
+
+#ifdef TRIE_STATS
+  writeOutputFormat(output, "build seconds.....: %.6f \n", trieStats.buildSeconds);
+  writeOutputFormat(output, "node allocations..: %ld \n", trieStats.nodeAllocations);
+  writeOutputFormat(output, "slab allocations..: %ld \n", trieStats.slabAllocations);
+  writeOutputFormat(output, "word allocations..: %ld \n", trieStats.wordAllocations);
+  writeOutputFormat(output, "insertions........: %ld \n", trieStats.insertions);
+  writeOutputFormat(output, "insert visits.....: %ld \n", trieStats.insertVisits);
+  writeOutputFormat(output, "lookups...........: %ld \n", trieStats.lookups);
+  writeOutputFormat(output, "lookup visits.....: %ld \n", trieStats.lookupVisits);
+  writeOutputFormat(output, "predictions.......: %ld \n", trieStats.predictions);
+  writeOutputFormat(output, "prediction visits.: %ld \n", trieStats.predictionVisits);
+  writeOutputFormat(output, "sibling visits....: %ld \n", trieStats.siblingVisits);
+  writeOutputFormat(output, "memo hits.........: %ld \n", trieStats.memoHits);
+  writeStatsLatencies(output);
+#else
+  writeOutputString(output, "instrumentation...: disabled, build with -DTRIE_STATS \n");
+#endif
+}
+
+/****************************************************************
+ * Auxiliary function. Counts the nodes of a trie below a node,
+ * the node included, and the words that end in them.
+ *
+ * @param		trie		      trie that owns the node
+ * @param		node		      root of the nodes to be counted
+ * @param		numberOfWords	incremented by the number of words found
+ *
+ * @return	long          number of nodes
+ */
+long countTrieNodes (Trie* trie, TrieNode* node, long* numberOfWords)
+{
+  long numberOfNodes = 1;   // nodes counted, this one included
+
+  if (node->count > 0)
+    (*numberOfWords)++;
+
+  for (TrieNode* child = getFirstChild(trie, node); child != NULL; child = getNextSibling(trie, child))
+    numberOfNodes += countTrieNodes(trie, child, numberOfWords);
+
+  return numberOfNodes;
+}
+
+/****************************************************************
+ * Gets the memory taken by a trie: its snapshot, if loaded, or its
+ * slabs, word records and spellings, with the successor arrays and
+ * labels if packed or compressed.
+ *
+ * @param		trie		      trie to be measured
+ *
+ * @return	size_t        number of bytes allocated
+ */
+size_t getTrieBytes (Trie* trie)
+{
+  size_t bytes;   // bytes counted so far
+
+  if (trie->mapping != NULL)
+    return trie->mappingSize;
+
+  bytes = (size_t) trie->numberOfSlabs * TRIE_SLAB_SIZE * sizeof(TrieNode) +
+          trie->slabTableSize * sizeof(TrieNode*) +
+          trie->wordTableSize * sizeof(TrieWord) + trie->spellingsSize;
+
+  if (trie->successorOffsets != NULL)
+    bytes += (trie->numberOfWords + 1) * sizeof(unsigned int) +
+             trie->numberOfSuccessors * (sizeof(TrieSuccessor) + sizeof(unsigned int));
+
+  if (trie->labels != NULL)
+    bytes += ((size_t) trie->numberOfSlabs << TRIE_SLAB_BITS) * sizeof(unsigned int) + trie->labelTextLength;
+
+  return bytes;
+}
+
+#ifdef TRIE_STATS
+/****************************************************************
+ * Auxiliary function. Adds the latency of a command to the
+ * histogram of its kind.
+ *
+ * @param		kind		      kind of the command, from 0 to TRIE_COMMAND_KINDS - 1
+ * @param		start		      start time of the command
+ */
+void recordCommandLatency (int kind, struct timespec* start)
+{
+  unsigned long long nanoseconds;   // latency of the command
+  int                bucket = 0;    // first power of two above the latency
+
+  nanoseconds = getElapsedSeconds(start) * 1e9;
+
+  while ((bucket < TRIE_LATENCY_BUCKETS - 1) && (nanoseconds >> bucket) > 0)
+    bucket++;
+
+  COUNT_STAT(commands[kind], 1);
+  COUNT_STAT(latencies[kind][bucket], 1);
+}
+
+/****************************************************************
+ * Auxiliary function. Prints the latency histogram of each kind
+ * of command, skipping empty buckets.
+ *
+ * @param		output		    output the histograms are written to
+ */
+void writeStatsLatencies (TrieOutput* output)
+{
+  char* names[TRIE_COMMAND_KINDS] = {"print", "prediction", "search", "statistics", "completion",
+                                     "top successors", "update"};
+
+  for (int kind = 0; kind < TRIE_COMMAND_KINDS; kind++)
+  {
+    if (trieStats.commands[kind] == 0)
+      continue;
+
+    writeOutputFormat(output, "%-18s: %ld \n", names[kind], trieStats.commands[kind]);
+
+    for (int bucket = 0; bucket < TRIE_LATENCY_BUCKETS; bucket++)
+    {
+      if (trieStats.latencies[kind][bucket] > 0)
+        writeOutputFormat(output, "  < 2^%-2d ns.......: %ld \n", bucket, trieStats.latencies[kind][bucket]);
+    }
+  }
+}
+#endif
+
+/****************************************************************
+ * Executes command for prefix autocomplete: prints the most
+ * frequent words that start with a prefix, most frequent first.
+ *
+ * @param		trie	        trie to be queried
+ * @param		phrase		    string with prefix and number of completions
+ * @param		output		    output the completions are written to
+ */
+void eventCommand5 (Trie* trie, char* phrase, TrieOutput* output)
+{
+  char           prefix[MAX_CHARACTERS_PER_WORD];    // prefix of the command
+  TrieSuccessor* words;                              // completions, with their counts
+  int            numberOfCompletions,                // completions asked for
+                 numberFound;                        // completions found
+
+  // consistency
+  if ((trie == NULL) || (phrase == NULL))
+    return;
+
+  numberOfCompletions = parsePredictionCommand(trie, phrase, prefix);
+
+  writeOutputString(output, prefix);
+
+  words = malloc((numberOfCompletions > 0 ? numberOfCompletions : 1) * sizeof(TrieSuccessor));
+
+  // consistency
+  if (words == NULL)
+  {
+    writeOutput(output, "\n", 1);
+    return;
+  }
+
+  numberFound = getCompletions(trie, prefix, numberOfCompletions, words);
+
+  if ((numberFound == 0) && (numberOfCompletions > 0))
+    writeOutputString(output, "(INVALID STRING)\n");
+  else
+    writeOutput(output, "\n", 1);
+
+  writeRankedWords(trie, words, numberFound, output);
+
+  free(words);
+}
+
+/****************************************************************
+ * Executes command for a bounded successor listing: prints the k
+ * most frequent words that follow a word, or its first k
+ * successors in alphabetical order, instead of all of them.
+ *
+ * @param		trie	        trie to be queried
+ * @param		phrase		    string with word and number of successors
+ * @param		alphabetical	whether successors are listed alphabetically, rather than by count
+ * @param		output		    output the successors are written to
+ */
+void eventCommand6 (Trie* trie, char* phrase, bool alphabetical, TrieOutput* output)
+{
+  char           word[MAX_CHARACTERS_PER_WORD];    // word of the command
+  TrieSuccessor* words;                            // successors, with their counts
+  int            numberOfSuccessors,               // successors asked for
+                 numberFound;                      // successors found
+
+  // consistency
+  if ((trie == NULL) || (phrase == NULL))
+    return;
+
+  numberOfSuccessors = parsePredictionCommand(trie, phrase, word);
+
+  writeOutputString(output, word);
+
+  words = malloc((numberOfSuccessors > 0 ? numberOfSuccessors : 1) * sizeof(TrieSuccessor));
+
+  // consistency
+  if (words == NULL)
+  {
+    writeOutput(output, "\n", 1);
+    return;
+  }
+
+  numberFound = getSuccessors(trie, word, numberOfSuccessors, alphabetical, words);
+
+  // same answers as the full listing for unknown words and words without successors
+  if (numberFound < 0)
+    writeOutputString(output, "(INVALID STRING)\n");
+  else if ((numberFound == 0) && !hasSuccessors(trie, getTrieNode(trie, trie->root, word)))
+    writeOutputString(output, "(EMPTY)\n");
+  else
+    writeOutput(output, "\n", 1);
+
+  writeRankedWords(trie, words, (numberFound > 0) ? numberFound : 0, output);
+
+  free(words);
+}
+
+/****************************************************************
+ * Executes command to insert a phrase into the trie, as if it were
+ * one more line of the corpus. Nothing is printed unless the
+ * phrase could not be inserted.
+ *
+ * @param		trie	        trie to be updated
+ * @param		phrase		    string with words
+ * @param		output		    output failures are written to
+ */
+void eventCommand7 (Trie* trie, char* phrase, TrieOutput* output)
+{
+  if (!updateTrie(trie, phrase))
+    writeOutputString(output, "(UPDATE FAILED)\n");
+}
+
+/****************************************************************
+ * Auxiliary function. Prints words found by a ranked query, one
+ * per line with its count.
+ *
+ * @param		trie	        trie that owns the words
+ * @param		words	        ids and counts of the words
+ * @param		numberOfWords	number of words
+ * @param		output		    output the words are written to
+ */
+void writeRankedWords (Trie* trie, TrieSuccessor* words, int numberOfWords, TrieOutput* output)
+{
+  for (int i = 0; i < numberOfWords; i++)
+  {
+    writeOutput(output, "- ", 2);
+    writeOutputString(output, getWordSpelling(trie, words[i].word));
+    writeOutput(output, " (", 2);
+    writeOutputNumber(output, words[i].count);
+    writeOutput(output, ")\n", 2);
+  }
+}
+
+/****************************************************************
+ * Auxiliary function. Prints all successors of a word of a packed
+ * trie, in alphabetical order, as printTrieNodeWordsSimpleFormat
+ * prints those of a subtrie.
+ *
+ * @param		trie	        trie that owns the successor arrays
+ * @param		word	        id of the word
+ * @param		output		    output the successors are written to
+ */
+void writePackedSuccessors (Trie* trie, unsigned int word, TrieOutput* output)
+{
+  unsigned int first = trie->successorOffsets[word],       // first entry of the word
+               last = trie->successorOffsets[word + 1];    // entry past its last one
+
+  writeRankedWords(trie, trie->successors + first, last - first, output);
+}
+
+/****************************************************************
+ * Finds the most frequent words of the main trie that start with
+ * a prefix, most frequent first. Ties go to the alphabetically
+ * first word.
+ *
+ * @param		trie	        trie to be queried
+ * @param		prefix		    prefix of the words; an empty prefix matches every word
+ * @param		numberOfCompletions  maximum number of words to find
+ * @param		words		      receives the ids and counts of the words found
+ *
+ * @return	int           number of words found
+ */
+int getCompletions (Trie* trie, char* prefix, int numberOfCompletions, TrieSuccessor* words)
+{
+  unsigned int nodeId = 0;    // id of the node of the prefix
+  char*        label = NULL;  // letters of its edge not yet matched, if compressed
+  int          remaining = 0; // number of those letters
+
+  // consistency
+  if ((trie == NULL) || (prefix == NULL))
+    return 0;
+
+  // finds node of the prefix, by id, as the ranking is indexed by id
+  for (; *prefix != '\0'; prefix++)
+  {
+    if (!isLetter(*prefix, trie->alphabet))
+      continue;
+
+    // a prefix that ends inside a compressed edge has the words of its node
+    if (remaining > 0)
+    {
+      if (*label != toLowercase(*prefix))
+        return 0;
+
+      label++;
+      remaining--;
+      continue;
+    }
+
+    nodeId = getChildId(trie, getNode(trie, nodeId), toLowercase(*prefix));
+
+    if (nodeId == 0)
+      return 0;
+
+    remaining = getNode(trie, nodeId)->labelLength;
+    label = getEdgeLabel(trie, nodeId);
+  }
+
+  return getTopWords(trie, nodeId, numberOfCompletions, words);
+}
+
+/****************************************************************
+ * Finds the words that follow a word, either the most frequent
+ * ones, with ties going to the alphabetically first word, or the
+ * alphabetically first ones. In a packed trie, both are the first
+ * entries of the word in the successor arrays.
+ *
+ * @param		trie	        trie to be queried
+ * @param		word		      word whose successors are listed
+ * @param		numberOfSuccessors  maximum number of words to find
+ * @param		alphabetical	whether the first words in alphabetical order are found, rather than the most frequent
+ * @param		words		      receives the ids and counts of the words found
+ *
+ * @return	int           number of words found, or -1 if the word is not in the trie
+ */
+int getSuccessors (Trie* trie, char* word, int numberOfSuccessors, bool alphabetical, TrieSuccessor* words)
+{
+  const TrieNode* node;   // node of the word
+
+  // consistency
+  if ((trie == NULL) || (word == NULL))
+    return -1;
+
+  node = getTrieNode(trie, trie->root, word);
+
+  // consistency
+  if (node == NULL)
+    return -1;
+
+  return getWordSuccessors(trie, node, numberOfSuccessors, alphabetical, words);
+}
+
+/****************************************************************
+ * Auxiliary function. Finds the words that follow the word of a
+ * node of the main trie; see getSuccessors.
+ *
+ * @param		trie	        trie to be queried
+ * @param		node		      node that ends the word, in the main trie
+ * @param		numberOfSuccessors  maximum number of words to find
+ * @param		alphabetical	whether the first words in alphabetical order are found, rather than the most frequent
+ * @param		words		      receives the ids and counts of the words found
+ *
+ * @return	int           number of words found
+ */
+int getWordSuccessors (Trie* trie, const TrieNode* node, int numberOfSuccessors, bool alphabetical, TrieSuccessor* words)
+{
+  int          numberFound = 0;     // number of words found
+  unsigned int first;               // first entry of the word, if packed
+
+  if (!hasSuccessors(trie, node) || (numberOfSuccessors <= 0))
+    return 0;
+
+  if (trie->successorOffsets != NULL)
+  {
+    first = trie->successorOffsets[node->word];
+
+    for (; (numberFound < numberOfSuccessors) && (first + numberFound < trie->successorOffsets[node->word + 1]);
+         numberFound++)
+      words[numberFound] = trie->successors[alphabetical ? first + numberFound :
+                                            trie->successorRanking[first + numberFound]];
+
+    return numberFound;
+  }
+
+  if (!alphabetical)
+    return getTopWords(trie, node->subtrie, numberOfSuccessors, words);
+
+  getFirstWords(trie, node->subtrie, numberOfSuccessors, words, &numberFound);
+
+  return numberFound;
+}
+
+/****************************************************************
+ * Auxiliary function. Finds the most frequent words below a node,
+ * in the main trie or in a successor subtrie. The search is best
+ * first: a heap holds subtries keyed by their rank and words keyed
+ * by their count and spelling, so subtries that cannot beat the
+ * words found are never opened, and the cost depends on the number
+ * of words asked for rather than on the size of the subtrie, even
+ * when most counts are equal. Ties go to the alphabetically first
+ * word.
+ *
+ * @param		trie	        trie to be queried
+ * @param		root		      id of the node below which words are searched
+ * @param		numberOfWords	maximum number of words to find
+ * @param		words		      receives the ids and counts of the words found, most frequent first
+ *
+ * @return	int           number of words found
+ */
+int getTopWords (Trie* trie, unsigned int root, int numberOfWords, TrieSuccessor* words)
+{
+  TrieCompletion* heap;               // subtries and words to be visited
+  TrieCompletion* grown;              // resized heap
+  TrieCompletion  item;               // item taken from the heap
+  TrieNode*       node;               // node of each item
+  TrieRank*       ranks;              // largest count below each node
+  int             heapLength = 0,     // number of items in the heap
+                  heapSize = 64,      // capacity of the heap
+                  numberFound = 0;    // number of words found
+
+  // consistency
+  if (numberOfWords <= 0)
+    return 0;
+
+  ranks = getRanks(trie);
+  heap = malloc(heapSize * sizeof(TrieCompletion));
+
+  // consistency
+  if ((ranks == NULL) || (heap == NULL))
+  {
+    free(heap);
+    return 0;
+  }
+
+  item.key = ranks[root].count;
+  item.node = root;
+  item.word = ranks[root].word;
+  item.subtrie = true;
+  pushCompletion(trie, heap, &heapLength, item);
+
+  while ((heapLength > 0) && (numberFound < numberOfWords))
+  {
+    item = popCompletion(trie, heap, &heapLength);
+
+    // a word comes out once no subtrie can hold a better one
+    if (!item.subtrie)
+    {
+      words[numberFound].word = item.word;
+      words[numberFound].count = item.key;
+      numberFound++;
+      continue;
+    }
+
+    node = getNode(trie, item.node);
+
+    // makes room for the word and the children of the subtrie
+    if (heapLength + 1 + getNumberOfChildren(trie, node) > heapSize)
+    {
+      heapSize = 2 * (heapLength + 1 + getNumberOfChildren(trie, node));
+      grown = realloc(heap, heapSize * sizeof(TrieCompletion));
+
+      // consistency
+      if (grown == NULL)
+        break;
+
+      heap = grown;
+    }
+
+    if ((node->count > 0) && (node->word != 0))
+    {
+      item.key = node->count;
+      item.word = node->word;
+      item.subtrie = false;
+      pushCompletion(trie, heap, &heapLength, item);
+    }
+
+    for (unsigned int child = node->child; child != 0; child = getNode(trie, child)->sibling)
+    {
+      item.key = ranks[child].count;
+      item.node = child;
+      item.word = ranks[child].word;
+      item.subtrie = true;
+      pushCompletion(trie, heap, &heapLength, item);
+    }
+  }
+
+  free(heap);
+
+  return numberFound;
+}
+
+/****************************************************************
+ * Auxiliary function. Finds the alphabetically first words below
+ * a node, in depth-first order, which is alphabetical since
+ * children are sorted, stopping once enough words are found.
+ *
+ * @param		trie	        trie to be queried
+ * @param		id		        id of the node below which words are searched
+ * @param		numberOfWords	maximum number of words to find
+ * @param		words		      receives the ids and counts of the words found
+ * @param		numberFound		number of words found so far, incremented
+ */
+void getFirstWords (Trie* trie, unsigned int id, int numberOfWords, TrieSuccessor* words, int* numberFound)
+{
+  TrieNode* node = getNode(trie, id);   // node of the trie
+
+  if ((node->count > 0) && (node->word != 0))
+  {
+    words[*numberFound].word = node->word;
+    words[*numberFound].count = node->count;
+    (*numberFound)++;
+  }
+
+  for (unsigned int child = node->child; (child != 0) && (*numberFound < numberOfWords);
+       child = getNode(trie, child)->sibling)
+    getFirstWords(trie, child, numberOfWords, words, numberFound);
+}
+
+/****************************************************************
+ * Auxiliary function. Gets the rank of each node of the main trie
+ * and of the successor subtries, indexed by node id: the largest
+ * word count below the node and the alphabetically first word with
+ * that count. It is computed on first use. Concurrent first calls
+ * each compute it, and all but one discard theirs, so the trie
+ * stays safe to query from several threads.
+ *
+ * @param		trie	        trie to be queried
+ *
+ * @return	TrieRank*     ranks, or NULL if out of memory
+ */
+TrieRank* getRanks (Trie* trie)
+{
+  TrieRank*     ranks;              // ranks computed by this call
+  TrieRank*     published = NULL;   // ranks already published by another call
+  TrieNode*     node;               // node of a word
+
+  ranks = __atomic_load_n(&trie->ranks, __ATOMIC_ACQUIRE);
+
+  if (ranks != NULL)
+    return ranks;
+
+  // covers every slab, so that nodes added by updates have a rank too
+  ranks = calloc((size_t) trie->numberOfSlabs << TRIE_SLAB_BITS, sizeof(TrieRank));
+
+  // consistency
+  if (ranks == NULL)
+    return NULL;
+
+  fillRanks(trie, 0, ranks);
+
+  for (unsigned int i = 1; i < trie->numberOfWords; i++)
+  {
+    node = getNode(trie, trie->words[i].node);
+
+    if (node->subtrie != 0)
+      fillRanks(trie, node->subtrie, ranks);
+  }
+
+  if (!__atomic_compare_exchange_n(&trie->ranks, &published, ranks, false,
+                                   __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE))
+  {
+    free(ranks);
+    ranks = published;
+  }
+
+  return ranks;
+}
+
+/****************************************************************
+ * Auxiliary function. Computes the rank of a node and of each of
+ * its descendants. Words are visited in alphabetical order, a node
+ * before its children, so the first word to reach the largest
+ * count is the alphabetically first one.
+ *
+ * @param		trie	        trie that owns the node
+ * @param		id	          id of the node
+ * @param		ranks	        ranks, indexed by node id
+ *
+ * @return	TrieRank      rank of the node
+ */
+TrieRank fillRanks (Trie* trie, unsigned int id, TrieRank* ranks)
+{
+  TrieNode* node = getNode(trie, id);   // node of the trie
+  TrieRank  rank = {0, 0},              // best rank so far
+            childRank;                  // rank of a child
+
+  if ((node->count > 0) && (node->word != 0))
+  {
+    rank.count = node->count;
+    rank.word = node->word;
+  }
+
+  for (unsigned int child = node->child; child != 0; child = getNode(trie, child)->sibling)
+  {
+    childRank = fillRanks(trie, child, ranks);
+
+    if (childRank.count > rank.count)
+      rank = childRank;
+  }
+
+  ranks[id] = rank;
+
+  return rank;
+}
+
+/****************************************************************
+ * Auxiliary function. Updates the ranks along the path of a word
+ * whose count grew, from a root down to the word. Counts only
+ * grow, so the word either takes over the rank of a node or the
+ * word ranked there still wins.
+ *
+ * @param		trie	        trie that owns the ranking
+ * @param		id	          id of the root, in the main trie or a successor subtrie
+ * @param		word	        id of the word record
+ * @param		count	        new count of the word below that root
+ */
+void updateRanks (Trie* trie, unsigned int id, unsigned int word, unsigned int count)
+{
+  char*     spelling = getWordSpelling(trie, word);   // spelling of the word
+  char*     letter = spelling;                        // next letter of the path
+  TrieRank* rank;                                     // rank of a node of the path
+
+  while (true)
+  {
+    rank = &trie->ranks[id];
+
+    // ties go to the alphabetically first word, as in fillRanks
+    if ((count > rank->count) ||
+        ((count == rank->count) && (strcmp(spelling, getWordSpelling(trie, rank->word)) < 0)))
+    {
+      rank->count = count;
+      rank->word = word;
+    }
+
+    if (*letter == '\0')
+      return;
+
+    id = getChildId(trie, getNode(trie, id), *letter);
+
+    // consistency
+    if (id == 0)
+      return;
+
+    letter++;
+  }
+}
+
+/****************************************************************
+ * Auxiliary function. Tells whether a completion item must leave
+ * the heap before another: higher counts first, then alphabetical
+ * order of the words, where a subtrie stands for the first word
+ * below it with its count; a subtrie goes before its own word, so
+ * that no word below it is passed over.
+ *
+ * @param		trie	        trie that owns the words
+ * @param		item	        first item
+ * @param		other	        second item
+ *
+ * @return	bool          true if the first item goes first; otherwise, false
+ */
+bool precedesCompletion (Trie* trie, TrieCompletion* item, TrieCompletion* other)
+{
+  int order;    // alphabetical order of the words
+
+  if (item->key != other->key)
+    return item->key > other->key;
+
+  if (item->word != other->word)
+  {
+    order = strcmp(getWordSpelling(trie, item->word), getWordSpelling(trie, other->word));
+
+    if (order != 0)
+      return order < 0;
+  }
+
+  return item->subtrie && !other->subtrie;
+}
+
+/****************************************************************
+ * Auxiliary function. Adds an item to a completion heap, which
+ * must have room for it.
+ *
+ * @param		trie	        trie that owns the words
+ * @param		heap	        binary heap of items
+ * @param		heapLength	  number of items, incremented
+ * @param		item	        item to be added
+ */
+void pushCompletion (Trie* trie, TrieCompletion* heap, int* heapLength, TrieCompletion item)
+{
+  int i = (*heapLength)++;   // position of the new item
+
+  // moves item up past the items it precedes
+  while ((i > 0) && precedesCompletion(trie, &item, &heap[(i - 1) / 2]))
+  {
+    heap[i] = heap[(i - 1) / 2];
+    i = (i - 1) / 2;
+  }
+
+  heap[i] = item;
+}
+
+/****************************************************************
+ * Auxiliary function. Removes the first item of a completion heap.
+ *
+ * @param		trie	        trie that owns the words
+ * @param		heap	        binary heap of items, not empty
+ * @param		heapLength	  number of items, decremented
+ *
+ * @return	TrieCompletion  first item
+ */
+TrieCompletion popCompletion (Trie* trie, TrieCompletion* heap, int* heapLength)
+{
+  TrieCompletion first = heap[0],                 // item removed
+                 last = heap[--(*heapLength)];    // item that fills the gap
+  int            i = 0,                           // position of the gap
+                 child;                           // first child of the gap
+
+  // moves gap down past the children that precede the last item
+  while ((child = 2 * i + 1) < *heapLength)
+  {
+    if ((child + 1 < *heapLength) && precedesCompletion(trie, &heap[child + 1], &heap[child]))
+      child++;
+
+    if (!precedesCompletion(trie, &heap[child], &last))
+      break;
+
+    heap[i] = heap[child];
+    i = child;
+  }
+
+  heap[i] = last;
+
+  return first;
+}
+
+/****************************************************************
+ * Prints the chain of most frequent successors of a word. Each
+ * word is predicted from the longest context of the last words
+ * that the trie knows, backing off to shorter contexts down to the
+ * last word alone, whose prediction is cached in its word record.
+ *
+ * @param		trie	        trie to be queried
+ * @param		node	        node of the first word, in the main trie
+ * @param		counter	      maximum number of words to predict
+ * @param		output		    output the words are written to
+ */
+void getTextPrediction (Trie* trie, const TrieNode* node, int counter, TrieOutput* output)
+{
+  unsigned int history[TRIE_MAX_ORDER];   // last words, the most recent last
+  unsigned int prediction;                // word predicted
+  int          historyLength = 1;         // number of words in the history
+
+  // consistency
+  if (node == NULL)
+    return;
+
+  COUNT_STAT(predictions, 1);
+
+  history[0] = node->word;
+
+  for (; counter > 0; counter--)
+  {
+    prediction = getContextPrediction(trie, history, historyLength);
+    COUNT_STAT(predictionVisits, 1);
+
+    // no successor was ever recorded
+    if (prediction == 0)
+      return;
+
+    // prints word on screen
+    writeOutput(output, " ", 1);
+    writeOutputString(output, getWordSpelling(trie, prediction));
+
+    // keeps the last order - 1 words
+    if (historyLength == trie->order - 1)
+    {
+      memmove(history, history + 1, (historyLength - 1) * sizeof(unsigned int));
+      historyLength--;
+    }
+
+    history[historyLength++] = prediction;
+
+    // hops to the predicted word in the main trie
+    node = getNode(trie, trie->words[prediction].node);
+
+    // consistency
+    if (!hasSuccessors(trie, node))
+      return;
+  }
+}
+
+/****************************************************************
+ * Prints the most likely chain of successors of a word, found by a
+ * beam search: at each step, every chain kept is extended with its
+ * most frequent successors, and only the beam width most likely
+ * chains are kept. A chain is scored by the log-probability of its
+ * words, each one estimated as the number of times it follows the
+ * context it is predicted from over the number of times the
+ * context occurs. A width of 1 gives the chain of
+ * getTextPrediction. The search stops early when no chain can be
+ * extended.
+ *
+ * @param		trie	        trie to be queried
+ * @param		node	        node of the first word, in the main trie
+ * @param		counter	      maximum number of words to predict
+ * @param		output		    output the words are written to
+ */
+void getBeamPrediction (Trie* trie, const TrieNode* node, int counter, TrieOutput* output)
+{
+  TrieBeamEntry* entries;                   // chains kept at each step, most likely first
+  TrieBeamEntry* previous;                  // chains of the previous step
+  TrieBeamEntry* current;                   // chains of the current step
+  TrieBeamEntry  entry;                     // chain being considered
+  TrieSuccessor* words;                     // successors of one chain
+  unsigned int   history[TRIE_MAX_ORDER];   // last words of a chain, the most recent last
+  unsigned int*  chain;                     // words of the best chain, in order
+  int            width = trie->beamWidth,   // number of chains kept
+                 numberOfPrevious = 1,      // chains of the previous step
+                 numberOfCurrent,           // chains of the current step
+                 numberFound,               // successors of one chain
+                 total,                     // occurrences of the context of a chain
+                 historyLength,             // number of words in the history
+                 steps = 0,                 // steps of the chains kept
+                 position,                  // position of a new chain
+                 index;                     // chain being walked back
+
+  // consistency
+  if ((node == NULL) || (counter <= 0))
+    return;
+
+  COUNT_STAT(predictions, 1);
+
+  entries = malloc(((size_t) counter + 1) * width * sizeof(TrieBeamEntry));
+  words = malloc(width * sizeof(TrieSuccessor));
+
+  // consistency
+  if ((entries == NULL) || (words == NULL))
+  {
+    free(entries);
+    free(words);
+    return;
+  }
+
+  entries[0].word = node->word;
+  entries[0].parent = -1;
+  entries[0].score = 0;
+
+  for (; steps < counter; steps++)
+  {
+    previous = entries + (size_t) steps * width;
+    current = previous + width;
+    numberOfCurrent = 0;
+
+    for (int i = 0; i < numberOfPrevious; i++)
+    {
+      // last order - 1 words of the chain, walked back from its end
+      historyLength = (steps + 1 < trie->order - 1) ? steps + 1 : trie->order - 1;
+      index = i;
+
+      for (int j = historyLength - 1, step = steps; j >= 0; j--, step--)
+      {
+        history[j] = entries[(size_t) step * width + index].word;
+        index = entries[(size_t) step * width + index].parent;
+      }
+
+      numberFound = getNextWords(trie, history, historyLength, width, words, &total);
+      COUNT_STAT(predictionVisits, 1);
+
+      // keeps the new chain if it beats one of those kept; ties go to the chain found first
+      for (int j = 0; j < numberFound; j++)
+      {
+        entry.word = words[j].word;
+        entry.parent = i;
+        entry.score = previous[i].score + log((double) words[j].count / ((total > words[j].count) ? total : words[j].count));
+
+        for (position = numberOfCurrent; (position > 0) && (current[position - 1].score < entry.score); position--)
+          ;
+
+        if (position >= width)
+          continue;
+
+        if (numberOfCurrent < width)
+          numberOfCurrent++;
+
+        memmove(current + position + 1, current + position, (numberOfCurrent - 1 - position) * sizeof(TrieBeamEntry));
+        current[position] = entry;
+      }
+    }
+
+    // no chain can be extended
+    if (numberOfCurrent == 0)
+      break;
+
+    numberOfPrevious = numberOfCurrent;
+  }
+
+  free(words);
+
+  // walks the best chain back from its end
+  chain = malloc(((size_t) steps + 1) * sizeof(unsigned int));
+
+  if (chain != NULL)
+  {
+    index = 0;
+
+    for (int step = steps; step >= 0; step--)
+    {
+      chain[step] = entries[(size_t) step * width + index].word;
+      index = entries[(size_t) step * width + index].parent;
+    }
+
+    for (int step = 1; step <= steps; step++)
+    {
+      writeOutput(output, " ", 1);
+      writeOutputString(output, getWordSpelling(trie, chain[step]));
+    }
+  }
+
+  free(chain);
+  free(entries);
+}
+
+/****************************************************************
+ * Prints a chain of successors of a word drawn at random: at each
+ * step, one of the sample size most frequent successors of the
+ * context, picked with a weight of its count raised to the power
+ * of 1 / temperature. A temperature of 1 follows the counts, a
+ * lower one favors the most frequent words, down to 0, which
+ * always picks the most frequent one, and a higher one flattens the
+ * weights. The generator is seeded with the seed of the trie and
+ * the word, so a command always gets the same chain for a seed,
+ * whatever the thread or batch that answers it.
+ *
+ * @param		trie	        trie to be queried
+ * @param		node	        node of the first word, in the main trie
+ * @param		counter	      maximum number of words to predict
+ * @param		output		    output the words are written to
+ */
+void getSampledPrediction (Trie* trie, const TrieNode* node, int counter, TrieOutput* output)
+{
+  TrieSuccessor*     words;                     // most frequent successors of the context
+  unsigned int       history[TRIE_MAX_ORDER];   // last words, the most recent last
+  unsigned long long state;                     // state of the generator
+  char*              spelling;                  // spelling of the first word
+  double             weight,                    // weight of all successors
+                     target;                    // weight at which the pick falls
+  int                historyLength = 1,         // number of words in the history
+                     numberFound,               // successors of the context
+                     total,                     // occurrences of the context
+                     pick;                      // successor picked
+
+  // consistency
+  if (node == NULL)
+    return;
+
+  COUNT_STAT(predictions, 1);
+
+  words = malloc(trie->sampleSize * sizeof(TrieSuccessor));
+
+  // consistency
+  if (words == NULL)
+    return;
+
+  spelling = getWordSpelling(trie, node->word);
+  state = (trie->seed ^ ((unsigned long long) hashKey(spelling, strlen(spelling)) << 32)) * 0x9e3779b97f4a7c15ULL;
+  state = (state != 0) ? state : 1;
+  history[0] = node->word;
+
+  for (; counter > 0; counter--)
+  {
+    numberFound = getNextWords(trie, history, historyLength, trie->sampleSize, words, &total);
+    COUNT_STAT(predictionVisits, 1);
+
+    // no successor was ever recorded
+    if (numberFound == 0)
+      break;
+
+    // weights relative to the most frequent successor, which cannot overflow
+    weight = 0;
+
+    for (int i = 0; (i < numberFound) && (trie->temperature > 0); i++)
+      weight += pow((double) words[i].count / words[0].count, 1 / trie->temperature);
+
+    target = (getNextRandom(&state) >> 11) * (1.0 / 9007199254740992.0) * weight;
+
+    for (pick = 0; (pick < numberFound - 1) && (trie->temperature > 0); pick++)
+    {
+      target -= pow((double) words[pick].count / words[0].count, 1 / trie->temperature);
+
+      if (target < 0)
+        break;
+    }
+
+    // prints word on screen
+    writeOutput(output, " ", 1);
+    writeOutputString(output, getWordSpelling(trie, words[pick].word));
+
+    // keeps the last order - 1 words
+    if (historyLength == trie->order - 1)
+    {
+      memmove(history, history + 1, (historyLength - 1) * sizeof(unsigned int));
+      historyLength--;
+    }
+
+    history[historyLength++] = words[pick].word;
+  }
+
+  free(words);
+}
+
+/****************************************************************
+ * Auxiliary function. Predicts the word that follows a history,
+ * from its longest suffix that is a context of the trie with a
+ * known successor.
+ *
+ * @param		trie	        trie to be queried
+ * @param		history	      ids of the last words, the most recent last
+ * @param		historyLength	number of words, at most order - 1
+ *
+ * @return	unsigned int  id of the predicted word, or 0 if there is none
+ */
+unsigned int getContextPrediction (Trie* trie, unsigned int* history, int historyLength)
+{
+  const TrieNode* context;   // node of the context
+
+  // contexts of two or more words, longest first
+  for (int start = 0; start < historyLength - 1; start++)
+  {
+    context = getContextNode(trie, history + start, historyLength - start);
+
+    if (context != NULL)
+      return getNode(trie, getNode(trie, context->subtrie)->word)->word;
+  }
+
+  // the last word alone
+  return trie->words[history[historyLength - 1]].prediction;
+}
+
+/****************************************************************
+ * Auxiliary function. Finds the node of a context of two or more
+ * words, if the trie knows a successor of it.
+ *
+ * @param		trie	        trie to be queried
+ * @param		history	      ids of the words of the context, the most recent last
+ * @param		historyLength	number of words, at least 2
+ *
+ * @return	const TrieNode*  node of the context, whose subtrie holds its successors, or NULL
+ */
+const TrieNode* getContextNode (Trie* trie, unsigned int* history, int historyLength)
+{
+  const TrieNode* context = getNode(trie, trie->words[history[0]].node);   // node of the context so far
+
+  for (int i = 1; (i < historyLength) && (context != NULL); i++)
+  {
+    context = (context->subtrie != 0) ?
+              getTrieNode(trie, getNode(trie, context->subtrie), getWordSpelling(trie, history[i])) : NULL;
+  }
+
+  // the root of the subtrie holds the node of the most frequent successor
+  if ((context == NULL) || (context->subtrie == 0) || (getNode(trie, context->subtrie)->word == 0))
+    return NULL;
+
+  return context;
+}
+
+/****************************************************************
+ * Auxiliary function. Finds the most frequent words that follow a
+ * history, most frequent first and alphabetically on ties, from
+ * its longest suffix that is a context of the trie with a known
+ * successor, as getContextPrediction, and how many times that
+ * suffix occurs. The successors of the last word alone come from
+ * the ranking of the successor subtries or from the successor
+ * arrays of a packed trie, so they cost little more than the words
+ * found; those of longer contexts, which are few, are all visited.
+ *
+ * @param		trie	        trie to be queried
+ * @param		history	      ids of the last words, the most recent last
+ * @param		historyLength	number of words, at most order - 1
+ * @param		numberOfWords	maximum number of words to find
+ * @param		words		      receives the ids and counts of the words found
+ * @param		total		      receives the number of times the suffix occurs
+ *
+ * @return	int           number of words found
+ */
+int getNextWords (Trie* trie, unsigned int* history, int historyLength, int numberOfWords,
+                  TrieSuccessor* words, int* total)
+{
+  const TrieNode* context;            // node of a context, or of the last word
+  int             numberFound = 0;    // number of words found
+
+  // contexts of two or more words, longest first
+  for (int start = 0; start < historyLength - 1; start++)
+  {
+    context = getContextNode(trie, history + start, historyLength - start);
+
+    if (context == NULL)
+      continue;
+
+    *total = context->count;
+    selectTopWords(trie, getNode(trie, context->subtrie), numberOfWords, words, &numberFound);
+
+    return numberFound;
+  }
+
+  // the last word alone
+  context = getNode(trie, trie->words[history[historyLength - 1]].node);
+  *total = context->count;
+
+  return getWordSuccessors(trie, context, numberOfWords, false, words);
+}
+
+/****************************************************************
+ * Auxiliary function. Keeps the most frequent words below a node
+ * in a list sorted by count. Words are visited in alphabetical
+ * order and only displace words of lower counts, so ties go to the
+ * alphabetically first word.
+ *
+ * @param		trie	        trie to be queried
+ * @param		node	        node below which words are searched
+ * @param		numberOfWords	maximum number of words to keep
+ * @param		words		      words kept so far, most frequent first
+ * @param		numberFound		number of words kept, updated
+ */
+void selectTopWords (Trie* trie, TrieNode* node, int numberOfWords, TrieSuccessor* words, int* numberFound)
+{
+  int position;   // position of the word in the list
+
+  if ((node->count > 0) && (node->word != 0))
+  {
+    for (position = *numberFound; (position > 0) && (words[position - 1].count < node->count); position--)
+      ;
+
+    if (position < numberOfWords)
+    {
+      if (*numberFound < numberOfWords)
+        (*numberFound)++;
+
+      memmove(words + position + 1, words + position, (*numberFound - 1 - position) * sizeof(TrieSuccessor));
+      words[position].word = node->word;
+      words[position].count = node->count;
+    }
+  }
+
+  for (TrieNode* child = getFirstChild(trie, node); child != NULL; child = getNextSibling(trie, child))
+    selectTopWords(trie, child, numberOfWords, words, numberFound);
+}
+
+/****************************************************************
+ * Auxiliary function. Makes room for more characters in an output.
+ *
+ * @param		output		    output to grow
+ * @param		length		    number of characters to be written
+ *
+ * @return  bool          true if there is room; otherwise, false
+ */
+bool reserveOutput (TrieOutput* output, size_t length)
+{
+  size_t size;    // new size of the output
+  char*  text;    // reallocated output
 
-bool      hasChildren                     (TrieNode* node);
+  if (output->length + length <= output->size)
+    return true;
 
-int       getNumberOfChildren             (TrieNode* node);
+  size = (output->size > 0) ? output->size : OUTPUT_FLUSH_SIZE;
 
-TrieNode* getTrieNode                     (TrieNode* root, char* word);
+  while (size < output->length + length)
+    size *= 2;
 
-void      insertPhrase                    (TrieNode* root, char* phrase);
+  text = realloc(output->text, size);
 
-int       getIndex                        (char letter);
+  // consistency
+  if (text == NULL)
+    return false;
 
-TrieNode* insertWord                      (TrieNode* node, char* word);
+  output->text = text;
+  output->size = size;
 
-void      runFileCommands                 (TrieNode* root, char* filename);
+  return true;
+}
 
-void      eventCommand1                   (TrieNode* root);
+/****************************************************************
+ * Appends characters to an output.
+ *
+ * @param		output		    output to be written
+ * @param		text		      characters to be appended
+ * @param		length		    number of characters
+ */
+void writeOutput (TrieOutput* output, char* text, size_t length)
+{
+  // consistency
+  if (!reserveOutput(output, length))
+    return;
 
-void      eventCommand2                   (TrieNode* root, char* phrase);
+  memcpy(output->text + output->length, text, length);
+  output->length += length;
+}
 
-void      eventCommand3                   (TrieNode* root, char* word);
+/****************************************************************
+ * Appends a string to an output.
+ *
+ * @param		output		    output to be written
+ * @param		text		      null-terminated string
+ */
+void writeOutputString (TrieOutput* output, char* text)
+{
+  writeOutput(output, text, strlen(text));
+}
 
-void      getTrieWords                    (TrieNode* root, char* listOfWords);
+/****************************************************************
+ * Appends a number, in decimal, to an output.
+ *
+ * @param		output		    output to be written
+ * @param		number		    number to be appended
+ */
+void writeOutputNumber (TrieOutput* output, long number)
+{
+  char          digits[24];                   // digits, from the right
+  int           position = sizeof(digits);    // first digit written
+  unsigned long value;                        // magnitude of the number
 
-void      getTrieNodeWords                (TrieNode* node, char* listOfWords, char* word);
+  value = (number < 0) ? -(unsigned long) number : (unsigned long) number;
 
-TrieNode* getMostFrequentWord             (TrieNode* node);
+  do
+  {
+    digits[--position] = '0' + value % 10;
+    value /= 10;
+  } while (value > 0);
 
-void      stripPunctuators                (char* string);
+  if (number < 0)
+    digits[--position] = '-';
 
-void      getTextPrediction               (TrieNode* root, TrieNode* node, int counter);
+  writeOutput(output, digits + position, sizeof(digits) - position);
+}
 
 /****************************************************************
- * Main function to start the application.
+ * Appends formatted text to an output, as printf would print it.
  *
- * @param		numberOfArguments		number of arguments used to run the application
- * @param		arguments						array of arguments used to run the application
- *
- * @return	int									program exit status
+ * @param		output		    output to be written
+ * @param		format		    printf format
  */
-int main (int numberOfArguments, char* arguments[])
+void writeOutputFormat (TrieOutput* output, char* format, ...)
 {
-	// variables
-  TrieNode* root;         // root of the trie
-  char*     filename1;    // name of the file with the words for the trie
-  char*     filename2;    // name of the file with the commands
+  va_list arguments;    // values to be formatted
+  int     length;       // number of characters formatted
 
-  // consistency
-  if(numberOfArguments < 3)
-  {
-    printf("Missing arguments!\n");
-    printf("Trie requires a text file to function properly.\n");
-  }
+  va_start(arguments, format);
+  length = vsnprintf(NULL, 0, format, arguments);
+  va_end(arguments);
 
-  filename1 = arguments[1];
-  filename2 = arguments[2];
+  // consistency; vsnprintf also writes the terminator
+  if ((length < 0) || !reserveOutput(output, length + 1))
+    return;
 
-  // creates trie from specified file
-  root = buildTrie(filename1);
+  va_start(arguments, format);
+  vsnprintf(output->text + output->length, length + 1, format, arguments);
+  va_end(arguments);
 
-  // runs command from input file
-  runFileCommands(root, filename2);
+  output->length += length;
+}
 
-  // deallocates memory
-  destroyTrie(root);
+/****************************************************************
+ * Writes an output on screen and empties it.
+ *
+ * @param		output		    output to be written
+ */
+void flushOutput (TrieOutput* output)
+{
+  if (output->length > 0)
+    fwrite(output->text, 1, output->length, stdout);
 
-	// indicates that the program is closing without any problem
-	return 0;
+  output->length = 0;
 }
 
 /****************************************************************
- * Builds trie root.
+ * Auxiliary function. Finds the answer of a command in a memo.
  *
- * @param		filenname		  name of the file with words for creation of the trie
+ * @param		memo		      answers of a batch
+ * @param		key		        normalized command
+ * @param		offset		    offset of the answer in the output, if found
+ * @param		length		    length of the answer, if found
  *
- * @return	TrieNode*     root of the new trie
+ * @return  bool          true if the command was answered before; otherwise, false
  */
-TrieNode* buildTrie (char* filename)
+bool findQueryMemo (TrieQueryMemo* memo, char* key, size_t* offset, size_t* length)
 {
-  TrieNode* root;                     // root of the trie
-  FILE*     file;                     // file with the words
-  char      phrase[MAX_CHARACTERS];   // string with words
+  TrieMemoEntry* entry;         // entry being probed
+  size_t         keyLength;     // length of the key
+  unsigned int   hash;          // hash of the key
 
   // consistency
-  if (filename == NULL)
-    return NULL;
+  if (memo->tableSize == 0)
+    return false;
 
-  // opens file
-  file = fopen(filename, "r");
+  keyLength = strlen(key);
+  hash = hashKey(key, keyLength);
 
-  // consistency
-  if (file == NULL)
+  // probes consecutive entries up to an empty one
+  for (unsigned int i = hash & (memo->tableSize - 1); memo->entries[i].keyLength != 0; i = (i + 1) & (memo->tableSize - 1))
   {
-    printf("\nError: Unable to open file %s.\n\n", filename);
-    return NULL;
-  }
+    entry = &memo->entries[i];
 
-   // creates root
-  root = createTrieNode();
+    if ((entry->hash == hash) && (entry->keyLength == keyLength) &&
+        (memcmp(memo->keys + entry->key, key, keyLength) == 0))
+    {
+      *offset = entry->offset;
+      *length = entry->length;
 
-  // reads file line-by-line
-  while (fgets(phrase, MAX_CHARACTERS, file) != NULL)
-  {
-    // inserts phrase into trie
-    insertPhrase(root, phrase);
+      return true;
+    }
   }
 
-  // closes file
-  fclose(file);
-
-  // returns trie root
-  return root;
+  return false;
 }
 
 /****************************************************************
- * Creates and initializes trie node.
+ * Auxiliary function. Records the answer of a command in a memo.
+ * The command must not be in the memo yet.
  *
- * @return	TrieNode*     new trie node
+ * @param		memo		      answers of a batch
+ * @param		key		        normalized command
+ * @param		offset		    offset of the answer in the output
+ * @param		length		    length of the answer
  */
-TrieNode* createTrieNode (void)
+void addQueryMemo (TrieQueryMemo* memo, char* key, size_t offset, size_t length)
 {
-  TrieNode* node;   // node of the trie
+  TrieMemoEntry* entry;         // new entry
+  size_t         keyLength;     // length of the key
+  size_t         keysSize;      // new size of the key arena
+  char*          keys;          // reallocated key arena
+  unsigned int   hash;          // hash of the key
+  unsigned int   i;             // index of the new entry
 
-  // Allocates and initializes root and children to null
-  node = calloc (1, sizeof(TrieNode));
+  keyLength = strlen(key);
 
-  return node;
+  // keeps the table at most half full
+  if ((2 * (memo->numberOfEntries + 1) > memo->tableSize) && !growQueryMemo(memo))
+    return;
+
+  // grows key arena
+  if (memo->keysLength + keyLength > memo->keysSize)
+  {
+    keysSize = (memo->keysSize > 0) ? 2 * memo->keysSize : OUTPUT_FLUSH_SIZE;
+
+    while (keysSize < memo->keysLength + keyLength)
+      keysSize *= 2;
+
+    keys = realloc(memo->keys, keysSize);
+
+    // consistency
+    if (keys == NULL)
+      return;
+
+    memo->keys = keys;
+    memo->keysSize = keysSize;
+  }
+
+  hash = hashKey(key, keyLength);
+
+  // finds empty entry
+  for (i = hash & (memo->tableSize - 1); memo->entries[i].keyLength != 0; i = (i + 1) & (memo->tableSize - 1));
+
+  entry = &memo->entries[i];
+  entry->key = memo->keysLength;
+  entry->keyLength = keyLength;
+  entry->hash = hash;
+  entry->offset = offset;
+  entry->length = length;
+
+  memcpy(memo->keys + memo->keysLength, key, keyLength);
+  memo->keysLength += keyLength;
+  memo->numberOfEntries++;
 }
 
 /****************************************************************
- * Destroys trie root.
+ * Auxiliary function. Doubles the table of a memo and moves its
+ * entries into the new table.
  *
- * @param		root		      root of the trie to be deleted with all children
+ * @param		memo		      answers of a batch
  *
- * @return	TrieNode*     root of the trie
-*/
-TrieNode* destroyTrie (TrieNode* root)
+ * @return  bool          true if the table was grown; otherwise, false
+ */
+bool growQueryMemo (TrieQueryMemo* memo)
 {
+  TrieMemoEntry* entries;       // new table
+  unsigned int   tableSize;     // size of the new table
+  unsigned int   j;             // index of an entry in the new table
+
+  tableSize = (memo->tableSize > 0) ? 2 * memo->tableSize : 1024;
+  entries = calloc(tableSize, sizeof(TrieMemoEntry));
+
   // consistency
-  if (root == NULL)
-    return NULL;
+  if (entries == NULL)
+    return false;
 
-  // recursively destroys children nodes
-  for (int i = 0; i < 26; i++)
-    destroyTrie(root->children[i]);
+  for (unsigned int i = 0; i < memo->tableSize; i++)
+  {
+    if (memo->entries[i].keyLength == 0)
+      continue;
 
-  // frees subtrie pointer
-  destroyTrie(root->subtrie);
+    for (j = memo->entries[i].hash & (tableSize - 1); entries[j].keyLength != 0; j = (j + 1) & (tableSize - 1));
 
-  // frees top level pointer
-  free(root);
+    entries[j] = memo->entries[i];
+  }
 
-  return NULL;
+  free(memo->entries);
+  memo->entries = entries;
+  memo->tableSize = tableSize;
 
+  return true;
 }
 
 /****************************************************************
- * Prints all trie contents on screen.
+ * Auxiliary function. Removes every answer from a memo, keeping
+ * its memory for the answers that follow.
  *
- * @param		root		      root of the trie
+ * @param		memo		      memo to be emptied
  */
-void printTrie (TrieNode* root)
+void clearQueryMemo (TrieQueryMemo* memo)
 {
-  int numberOfChildren;   // number of children of the root
-
-  // consistency
-  if (root == NULL)
-    return;
+  if (memo->entries != NULL)
+    memset(memo->entries, 0, memo->tableSize * sizeof(TrieMemoEntry));
 
-  // gets number of children
-  numberOfChildren = getNumberOfChildren(root);
+  memo->numberOfEntries = 0;
+  memo->keysLength = 0;
+}
 
-  printf("root: \n");
-  printf("count.............: %d \n", root->count);
-  printf("number of children: %d \n", numberOfChildren);
+/****************************************************************
+ * Auxiliary function. Hashes a key with FNV-1a.
+ *
+ * @param		key		        characters of the key
+ * @param		length		    number of characters
+ *
+ * @return  unsigned int  hash of the key
+ */
+unsigned int hashKey (char* key, size_t length)
+{
+  unsigned int hash = 2166136261u;    // offset basis
 
-  if (numberOfChildren > 0)
+  for (size_t i = 0; i < length; i++)
   {
-    printf("children..........: \n");
-
-    for (int i = 0; i < 26; i++)
-    {
-      if (root->children[i] != NULL)
-      {
-        printf("  child index.......: %d \n", i);
-        printf("  letter............: %c \n", ('a' + i));
-        printTrieNode(root->children[i], " ");
-      }
-    }
+    hash ^= (unsigned char) key[i];
+    hash *= 16777619u;
   }
-  printf("subtrie...........: %p \n", root->subtrie);
+
+  return hash;
 }
 
 /****************************************************************
- * Auxiliary function. Prints trie node and its subnodes on screen.
+ * Builds a trie from a corpus, once with each build function, and
+ * reports build time, teardown time and memory used by the nodes,
+ * then times lookups, successor listings and predictions on it.
+ * Given a command file, also reports command throughput by number
+ * of threads. Each measurement is one line of tab-separated
+ * benchmark, metric and value.
  *
- * @param		node		      node of the trie
- * @param		tabString		  string with tab characters
+ * @param		filename		      name of the corpus file
+ * @param		commandFilename		name of the command file, or NULL
  */
-void printTrieNode (TrieNode* node, char* tabString)
+void runBenchmark (char* filename, char* commandFilename)
 {
-  int   numberOfChildren;                       // number of children of the node
-  char  string[2 * MAX_CHARACTERS_PER_WORD];    // string with word and tab
+  Trie*           trie;             // trie built from the corpus
+  struct timespec start;            // start time of each build
+  struct rusage   usage;            // resource usage of the process
+  struct stat     corpus;           // status of the corpus file
+  char            name[32];         // name of a build
+  char            snapshot[] = "/tmp/TriePredictionXXXXXX";   // scratch snapshot file
+  double          seconds;          // time spent saving the snapshot
+  int             descriptor;       // descriptor of the scratch snapshot
+  unsigned int    numberOfNodes;    // nodes before freezing
 
   // consistency
-  if (node == NULL)
+  if (stat(filename, &corpus) != 0)
+  {
+    printf("\nError: Unable to open file %s.\n\n", filename);
     return;
+  }
 
-  // gets number of children
-  numberOfChildren = getNumberOfChildren(node);
+  printf("benchmark\tmetric\tvalue\n");
 
-  strcpy(string, tabString);
-  strcat(string, " ");
+  reportMetric("corpus", "bytes", corpus.st_size);
+  reportMetric("node", "bytes", sizeof(TrieNode));
 
-  printf(string);
-  printf("count.............: %d \n", node->count);
+  // serial builds
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  trie = buildTrie(filename);
+  reportBuildBenchmark("build/stream", trie, getElapsedSeconds(&start), corpus.st_size);
 
-  printf(string);
-  printf("number of children: %d \n", numberOfChildren);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  trie = buildTrieFromMappedFile(filename);
+  reportBuildBenchmark("build/mmap", trie, getElapsedSeconds(&start), corpus.st_size);
 
-  if (numberOfChildren > 0)
+  // parallel builds
+  for (int numberOfThreads = 1; numberOfThreads <= 16; numberOfThreads *= 2)
   {
-    printf(string);
-    printf("children: \n");
+    sprintf(name, "build/parallel-%d", numberOfThreads);
 
-    for (int i = 0; i < 26; i++)
-    {
-      if (node->children[i] != NULL)
-      {
-        printf(string);
-        printf(" child index.......: %d \n", i);
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    trie = buildTrieInParallel(filename, numberOfThreads, TRIE_ALPHABET_LETTERS);
+    reportBuildBenchmark(name, trie, getElapsedSeconds(&start), corpus.st_size);
+  }
 
-        printf(string);
-        printf(" letter............: %c \n", ('a' + i));
+  // digits and UTF-8 characters kept in the words
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  trie = buildTrieInParallel(filename, 1, TRIE_ALPHABET_BYTES);
+  reportBuildBenchmark("build/bytes-alphabet", trie, getElapsedSeconds(&start), corpus.st_size);
 
-        printTrieNode(node->children[i], string);
-      }
-    }
-  }
+  // snapshot round trip
+  descriptor = mkstemp(snapshot);
+  trie = buildTrieFromMappedFile(filename);
 
-  printf(string);
-  if (node->subtrie != NULL)
+  if ((descriptor >= 0) && (trie != NULL))
   {
-    printf("subtrie...........: %p \n", node->subtrie);
-    printTrieNode(node->subtrie, string);
+    close(descriptor);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    saveTrie(trie, snapshot);
+    seconds = getElapsedSeconds(&start);
+    destroyTrie(trie);
+
+    reportMetric("snapshot/save", "seconds", seconds);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    trie = loadTrie(snapshot);
+    reportBuildBenchmark("snapshot/load", trie, getElapsedSeconds(&start), corpus.st_size);
+
+    unlink(snapshot);
   }
   else
   {
-    printf("subtrie...........: none \n");
-  }
-
-}
+    destroyTrie(trie);
 
-/****************************************************************
- * Prints all trie contents on screen.
- *
- * @param		root		      root of the trie
- */
-void printTrieSimpleFormat (TrieNode* root)
-{
-   /*
-    Creates string called rootWord to hold first letter of the word.
-    Cycles recursively through nodes to append the letters into the word string.
-    Once the count is greater than zero, which indicates end-of-word,
-    that is when the word and its count are printed on screen.
+    if (descriptor >= 0)
+    {
+      close(descriptor);
+      unlink(snapshot);
+    }
+  }
 
-    Since each node index represents a letter, it converts that index
-    into a char to be appended to the word string.
- */
+  // queries in the bytes alphabet
+  trie = buildTrieInParallel(filename, 1, TRIE_ALPHABET_BYTES);
 
-  int   numberOfChildren;                     // number of children of root node
-  char  rootWord[MAX_CHARACTERS_PER_WORD];    // word to be completed by node content
-  char  letter[2];                            // first letter of the word
+  if (trie != NULL)
+    runLookupBenchmark(trie, "bytes-alphabet");
 
-  // consistency
-  if (root == NULL)
-    return;
+  destroyTrie(trie);
 
-  // gets number of children
-  numberOfChildren = getNumberOfChildren(root);
+  // queries on compressed edges
+  trie = buildTrieFromMappedFile(filename);
+  numberOfNodes = (trie != NULL) ? trie->numberOfNodes : 0;
 
-  // if a child exists, cycles pointer through children
-  if (numberOfChildren > 0)
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if ((trie != NULL) && compressTrie(trie))
   {
-    for (int i = 0; i < 26; i++)
-    {
-      if (root->children[i] != NULL)
-      {
-        // takes first letter of word and creates a string
-        letter[0] = 'a' + i;
-        letter[1] = '\0';
+    reportMetric("compress", "seconds", getElapsedSeconds(&start));
+    reportMetric("compress", "nodes before", numberOfNodes);
+    reportMetric("compress", "nodes", trie->numberOfNodes);
+    reportMetric("compress", "node bytes", trie->numberOfNodes * (double) sizeof(TrieNode));
+    reportMetric("compress", "label bytes", trie->numberOfNodes * (double) sizeof(unsigned int) +
+                 trie->labelTextLength);
+    runLookupBenchmark(trie, "compressed");
+  }
 
-        // inserts first letter into word string
-        strcpy(rootWord, letter);
+  destroyTrie(trie);
 
-        // recursive call into child nodes
-        printTrieNodeWordsSimpleFormat(root->children[i], rootWord);
-      }
-    }
-  }
-}
+  // queries on a compacted model, and its predictions against those of the whole one
+  trie = buildTrieFromMappedFile(filename);
+  runCompactBenchmark(trie, filename);
+  destroyTrie(trie);
 
-/****************************************************************
- * Auxiliary function. Prints trie node words on screen.
- *
- * @param		node		      node of the trie
- * @param		word		      buffer to store the letters of the word, through the nodes
- */
-void printTrieNodeWordsSimpleFormat (TrieNode* node, char* word)
-{
-  int   numberOfChildren;                     // number of children of this node
-  char  nodeWord[MAX_CHARACTERS_PER_WORD],    // word from this node forward
-        letter[2];                            // letter corresponding to this node
+  // successor counts estimated in fixed memory, against the exact ones
+  runSketchBenchmark(filename);
 
-  // consistency
-  if (node == NULL)
-    return;
+  // queries, and command throughput
+  trie = buildTrieFromMappedFile(filename);
+  runLookupBenchmark(trie, "query");
 
-  // when the count is greater than zero, it has reached the end of a word
-  if (node->count > 0)
-    printf("%s (%d)\n", word, node->count);
+  if (commandFilename != NULL)
+    runQueryBenchmark(trie, commandFilename);
 
-  // gets number of children
-  numberOfChildren = getNumberOfChildren(node);
+  // the same queries on the frozen layout
+  numberOfNodes = trie->numberOfNodes;
 
-  // if a child exists, cycles through nodes to append letters to the word
-  if (numberOfChildren > 0)
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (freezeTrie(trie))
   {
-    for (int i = 0; i < 26; i++)
-    {
-      if (node->children[i] != NULL)
-      {
-        // current letter
-        letter[0] = 'a' + i;
-        letter[1] = '\0';
+    reportMetric("freeze", "seconds", getElapsedSeconds(&start));
+    reportMetric("freeze", "nodes", numberOfNodes);
+    reportMetric("freeze", "slots", trie->numberOfNodes);
+    reportMetric("freeze", "node bytes", trie->numberOfNodes * (double) sizeof(TrieNode));
+    runLookupBenchmark(trie, "frozen");
+  }
 
-        // copies received partial word into final word string
-        strcpy(nodeWord, word);
+  runUpdateBenchmark(trie);
 
-        // appends next letter into final word string
-        strcat(nodeWord, letter);
+  // the same queries with packed successors
+  numberOfNodes = trie->numberOfNodes;
 
-        // recursive call to print child nodes
-        printTrieNodeWordsSimpleFormat(node->children[i], nodeWord);
-      }
-    }
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (packTrie(trie))
+  {
+    reportMetric("pack", "seconds", getElapsedSeconds(&start));
+    reportMetric("pack", "nodes before", numberOfNodes);
+    reportMetric("pack", "nodes", trie->numberOfNodes);
+    reportMetric("pack", "node bytes", trie->numberOfNodes * (double) sizeof(TrieNode));
+    reportMetric("pack", "successors", trie->numberOfSuccessors);
+    reportMetric("pack", "successor bytes", (trie->numberOfWords + 1.0) * sizeof(unsigned int) +
+                 trie->numberOfSuccessors * (double) (sizeof(TrieSuccessor) + sizeof(unsigned int)));
+    runLookupBenchmark(trie, "packed");
   }
+
+  destroyTrie(trie);
+
+  runInsertBenchmark();
+  runTokenizeBenchmark(filename);
+
+  // peak resident set size, in kilobytes
+  getrusage(RUSAGE_SELF, &usage);
+
+  reportMetric("process", "peak RSS KB", usage.ru_maxrss);
 }
 
 /****************************************************************
- * Checks if node has children.
- *
- * @param		node		      node of the trie
+ * Auxiliary function. Reports a build and times the teardown of
+ * the trie it built.
  *
- * @return  bool          true if has children; otherwise, false
+ * @param		name		      name of the build mode
+ * @param		trie		      trie that was built
+ * @param		buildSeconds	time spent building
+ * @param		size		      size of the corpus file, in bytes
  */
-bool hasChildren (TrieNode* node)
+void reportBuildBenchmark (char* name, Trie* trie, double buildSeconds, off_t size)
 {
+  struct timespec start;            // start time of the teardown
+  double          destroySeconds;   // time spent in destroyTrie
+  long            numberOfNodes;    // number of nodes built
+
   // consistency
-  if (node == NULL)
-    return false;
+  if (trie == NULL)
+    return;
 
-  // checks if there is at least one child
-  for (int i = 0; i < 26; i++)
-  {
-    // returns true
-    if (node->children[i] != NULL)
-      return true;
-  }
+  numberOfNodes = trie->numberOfNodes;
 
-  // returns false
-  return false;
+  // destroys trie
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  destroyTrie(trie);
+  destroySeconds = getElapsedSeconds(&start);
+
+  reportMetric(name, "nodes", numberOfNodes);
+  reportMetric(name, "node bytes", numberOfNodes * (double) sizeof(TrieNode));
+  reportMetric(name, "seconds", buildSeconds);
+  reportMetric(name, "MB/s", size / 1e6 / buildSeconds);
+  reportMetric(name, "destroy seconds", destroySeconds);
 }
 
 /****************************************************************
- * Gets number of child nodes.
- *
- * @param		node		      node of the trie
- *
- * @return  int           number of children
+ * Auxiliary function. Times insertWord on ever longer tokens and
+ * insertPhrase on ever longer lines. Linear cost shows up as a
+ * constant time per character.
  */
-int getNumberOfChildren (TrieNode* node)
+void runInsertBenchmark (void)
 {
-  int numberOfChildren = 0;   // number of children of the node
+  Trie*           trie;         // scratch trie
+  struct timespec start;        // start time of each measurement
+  char*           text;         // token or line to be inserted
+  double          seconds;      // time spent inserting
+  char            name[32];     // name of each measurement
+  int             repetitions = 8;
+
+  for (int length = 1 << 10; length <= 1 << 18; length <<= 2)
+  {
+    text = malloc(length + 1);
+    trie = createTrie();
 
-  // consistency
-  if (node == NULL)
-    return 0;
+    // consistency
+    if ((text == NULL) || (trie == NULL))
+    {
+      free(text);
+      destroyTrie(trie);
+      return;
+    }
 
-  // traverses the array of children
-  for (int i = 0; i < 26; i++)
-  {
-    // if it is not null, increments counter
-    if (node->children[i] != NULL)
-      numberOfChildren++;
-  }
+    // long token: one letter after the other
+    for (int i = 0; i < length; i++)
+      text[i] = 'a' + (i * 7) % 26;
+    text[length] = '\0';
 
-  // returns counter
-  return numberOfChildren;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < repetitions; i++)
+      insertWord(trie, trie->root, text, NULL);
+    seconds = getElapsedSeconds(&start);
+
+    sprintf(name, "insertWord/%d", length);
+    reportMetric(name, "ns/letter", seconds * 1e9 / ((double) length * repetitions));
+
+    // long line: two-letter words separated by spaces
+    for (int i = 0; i < length; i++)
+      text[i] = (i % 3 == 2) ? ' ' : 'a' + (i * 7) % 26;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < repetitions; i++)
+      insertPhrase(trie, text);
+    seconds = getElapsedSeconds(&start);
+
+    sprintf(name, "insertPhrase/%d", length);
+    reportMetric(name, "ns/character", seconds * 1e9 / ((double) length * repetitions));
+
+    destroyTrie(trie);
+    free(text);
+  }
 }
 
 /****************************************************************
- * Gets node.
- *
- * @param		root		      root of the trie
- * @param		word		      string with the word to be found
+ * Auxiliary function. Answers a command file with 1 to 16 threads
+ * and reports throughput and speedup over one thread. Answers are
+ * discarded.
  *
- * @return  TrieNode*     node of the trie
+ * @param		trie		      trie to be queried
+ * @param		filename		  name of the command file
  */
-TrieNode* getTrieNode (TrieNode* root, char* word)
+void runQueryBenchmark (Trie* trie, char* filename)
 {
-  TrieNode* node = NULL;    // node of the trie
-  int       length,         // number of letters of the word
-            index;          // index of the node
+  TrieQueryTask*  tasks;              // one task per thread
+  struct timespec start;              // start time of each run
+  char*           text;               // contents of the command file
+  size_t          size;               // size of the command file
+  size_t          outputLength;       // number of characters answered
+  long            numberOfCommands;   // number of commands answered
+  double          seconds,            // time spent answering
+                  baseSeconds = 0;    // time spent by one thread
+  char            name[32];           // name of each run
+
+  text = mapFile(filename, &size, MADV_SEQUENTIAL);
 
   // consistency
-  if ((root == NULL) || (word == NULL))
-    return NULL;
-
-  // trie only accepts lowercase
-  strlwr(word);
+  if ((trie == NULL) || (text == NULL))
+    return;
 
-  // removes punctuation marks if they exist
-  stripPunctuators(word);
+  for (int numberOfThreads = 1; numberOfThreads <= 16; numberOfThreads *= 2)
+  {
+    tasks = calloc(numberOfThreads, sizeof(TrieQueryTask));
 
-  // gets length
-  length = strlen(word);
+    // consistency
+    if (tasks == NULL)
+      break;
 
-  // consistency
-  if (length == 0)
-    return NULL;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    runQueryTasks(trie, text, size, tasks, numberOfThreads);
+    seconds = getElapsedSeconds(&start);
 
-  // starts search at root
-  node = root;
+    if (numberOfThreads == 1)
+      baseSeconds = seconds;
 
-  // cycles through children
-  for (int i = 0; i < length; i++)
-  {
-    // searches for next letter
-    index = word[i]-'a';
+    outputLength = 0;
+    numberOfCommands = 0;
 
-    // if the pointer is at the last non-null node, it found the word
-    if (node->children[index] != NULL)
-    {
-      node = node->children[index];
-    }
-    else
+    for (int i = 0; i < numberOfThreads; i++)
     {
-      return NULL;
+      outputLength += tasks[i].output.length;
+      numberOfCommands += tasks[i].numberOfCommands;
+      free(tasks[i].output.text);
     }
+
+    free(tasks);
+
+    sprintf(name, "commands/threads-%d", numberOfThreads);
+    reportMetric(name, "commands", numberOfCommands);
+    reportMetric(name, "output bytes", outputLength);
+    reportMetric(name, "seconds", seconds);
+    reportMetric(name, "commands/s", numberOfCommands / seconds);
+    reportMetric(name, "ns/op", seconds * 1e9 / numberOfCommands);
+    reportMetric(name, "speedup", baseSeconds / seconds);
   }
 
-  return node;
+  munmap(text, size);
 }
 
 /****************************************************************
- * Inserts phrase into trie root.
+ * Auxiliary function. Times lookups, successor listings,
+ * predictions and completions of the words of a trie, picked in a
+ * scattered order.
  *
- * @param		root		      root of the trie
- * @param		phrase		    string with words
+ * @param		trie		      trie to be queried
+ * @param		prefix		    prefix of the names of the measurements
  */
-void insertPhrase (TrieNode* root, char* phrase)
+void runLookupBenchmark (Trie* trie, char* prefix)
 {
-  TrieNode* previousWordNode = NULL;          // previous node of the word
-  int       length,                           // number of letters of the word
-            index2 = 0;                       // index of a letter of the word
-  char      word[MAX_CHARACTERS_PER_WORD],    // word
-            delimiter = ' ';                  // separator of words
-
-  // consistency
-  if ((root == NULL) || (phrase == NULL))
+  TrieOutput      output = {0};                         // answers, discarded after each query
+  struct timespec start;                                // start time of each measurement
+  char            phrase[MAX_CHARACTERS_PER_WORD + 8];  // prediction command
+  char*           word;                                 // word being queried
+  char            name[32];                             // name of each measurement
+  long            found = 0;                            // number of words found
+  size_t          outputLength = 0;                     // number of characters answered
+  double          seconds;                              // time spent querying
+  int             operations;                           // number of queries of each kind
+
+  // consistency; record 0 is the empty word
+  if ((trie == NULL) || (trie->numberOfWords < 2))
     return;
 
-  // calculates phrase length
-  length = strlen(phrase);
+  // lookups, as in the word search and prediction commands
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (unsigned int i = 0; i < BENCHMARK_OPERATIONS; i++)
+  {
+    word = getWordSpelling(trie, 1 + (i * 2654435761u) % (trie->numberOfWords - 1));
+    found += (getTrieNode(trie, trie->root, word) != NULL);
+  }
+  seconds = getElapsedSeconds(&start);
+
+  sprintf(name, "%s/lookup", prefix);
+  reportMetric(name, "operations", BENCHMARK_OPERATIONS);
+  reportMetric(name, "found", found);
+  reportMetric(name, "ns/op", seconds * 1e9 / BENCHMARK_OPERATIONS);
+
+  // successor listings; a subtrie can hold many words, so there are fewer of them
+  operations = BENCHMARK_OPERATIONS / 16;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (int i = 0; i < operations; i++)
+  {
+    eventCommand3(trie, getWordSpelling(trie, 1 + (i * 2654435761u) % (trie->numberOfWords - 1)), &output);
+    outputLength += output.length;
+    output.length = 0;
+  }
+  seconds = getElapsedSeconds(&start);
+
+  sprintf(name, "%s/successors", prefix);
+  reportMetric(name, "operations", operations);
+  reportMetric(name, "output bytes", outputLength);
+  reportMetric(name, "ns/op", seconds * 1e9 / operations);
+
+  // ten most frequent successors
+  outputLength = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (unsigned int i = 0; i < BENCHMARK_OPERATIONS; i++)
+  {
+    word = getWordSpelling(trie, 1 + (i * 2654435761u) % (trie->numberOfWords - 1));
+    sprintf(phrase, "%s 10", word);
+
+    eventCommand6(trie, phrase, false, &output);
+    outputLength += output.length;
+    output.length = 0;
+  }
+  seconds = getElapsedSeconds(&start);
+
+  sprintf(name, "%s/top successors", prefix);
+  reportMetric(name, "operations", BENCHMARK_OPERATIONS);
+  reportMetric(name, "output bytes", outputLength);
+  reportMetric(name, "ns/op", seconds * 1e9 / BENCHMARK_OPERATIONS);
 
-  // consistency
-  if (length == 0)
-    return;
+  // prediction chains of ten words
+  outputLength = 0;
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (unsigned int i = 0; i < BENCHMARK_OPERATIONS; i++)
+  {
+    word = getWordSpelling(trie, 1 + (i * 2654435761u) % (trie->numberOfWords - 1));
+    sprintf(phrase, "%s 10", word);
 
-  // transforms phrase into lowercase
-  strlwr(phrase);
+    eventCommand2(trie, phrase, &output);
+    outputLength += output.length;
+    output.length = 0;
+  }
+  seconds = getElapsedSeconds(&start);
 
-  // removes punctuation from phrase
-  stripPunctuators(phrase);
+  sprintf(name, "%s/prediction", prefix);
+  reportMetric(name, "operations", BENCHMARK_OPERATIONS);
+  reportMetric(name, "output bytes", outputLength);
+  reportMetric(name, "ns/op", seconds * 1e9 / BENCHMARK_OPERATIONS);
 
-  // traverses characters of phrase
-  for (int index1 = 0; index1 <= strlen(phrase); index1++)
+  // the same chains from a beam of four, then drawn from the ten most frequent successors
+  for (int mode = 0; mode < 2; mode++)
   {
-     // checks if it is a valid letter
-     if ((phrase[index1] != delimiter) && (phrase[index1] != '\0'))
-     {
-       // adds letter to word
-       word[index2] = phrase[index1];
+    setPredictionMode(trie, (mode == 0) ? 4 : 0, (mode == 0) ? 0 : 10, 1, 1);
+    operations = BENCHMARK_OPERATIONS / 4;
+    outputLength = 0;
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    for (int i = 0; i < operations; i++)
+    {
+      word = getWordSpelling(trie, 1 + (i * 2654435761u) % (trie->numberOfWords - 1));
+      sprintf(phrase, "%s 10", word);
+
+      eventCommand2(trie, phrase, &output);
+      outputLength += output.length;
+      output.length = 0;
+    }
+    seconds = getElapsedSeconds(&start);
 
-       // increments index
-       index2++;
-     }
-     else
-     {
-       // finalizes word string
-       word[index2] = '\0';
+    sprintf(name, "%s/%s prediction", prefix, (mode == 0) ? "beam" : "sampled");
+    reportMetric(name, "operations", operations);
+    reportMetric(name, "output bytes", outputLength);
+    reportMetric(name, "ns/op", seconds * 1e9 / operations);
+  }
 
-       // inserts word into previous word subtrie
-       if (previousWordNode != NULL)
-       {
-          if (previousWordNode->subtrie == NULL)
-            previousWordNode->subtrie = createTrieNode();
+  setPredictionMode(trie, 0, 0, 1, 1);
 
-          insertWord(previousWordNode->subtrie, word);
-       }
+  // top ten completions of the first two letters of each word
+  outputLength = 0;
 
-       // recursively inserts word into root
-       previousWordNode = insertWord(root, word);
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  for (unsigned int i = 0; i < BENCHMARK_OPERATIONS; i++)
+  {
+    word = getWordSpelling(trie, 1 + (i * 2654435761u) % (trie->numberOfWords - 1));
+    sprintf(phrase, "%.2s 10", word);
 
-       // resets index
-       index2 = 0;
-     }
+    eventCommand5(trie, phrase, &output);
+    outputLength += output.length;
+    output.length = 0;
   }
+  seconds = getElapsedSeconds(&start);
+
+  sprintf(name, "%s/completion", prefix);
+  reportMetric(name, "operations", BENCHMARK_OPERATIONS);
+  reportMetric(name, "output bytes", outputLength);
+  reportMetric(name, "ns/op", seconds * 1e9 / BENCHMARK_OPERATIONS);
+
+  free(output.text);
 }
+
 /****************************************************************
- * Calculates character index.
+ * Measures updates of a live trie: phrases of words of the corpus
+ * are inserted while the ranking of completions and successors is
+ * kept current, each followed by a completion query.
  *
- * @param		letter		    letter
- * @param		index		      index related to the letter, from 0 to 25
+ * @param		trie		      trie to be updated, with its ranking already built
  */
-int getIndex (char letter)
+void runUpdateBenchmark (Trie* trie)
 {
-  // trie only accepts lowercase
-  int index = tolower(letter) - 'a';    // index of a node, from 0 to 25
+  struct timespec start;                            // start time of each measurement
+  char            phrase[MAX_CHARACTERS];           // phrase of each update
+  TrieSuccessor   words[10];                        // completions of each query
+  unsigned int    numberOfNodes = trie->numberOfNodes;
+  unsigned int    numberOfWords = trie->numberOfWords;
+  unsigned long long state = 1;                     // state of the word picker
+  double          updateSeconds = 0,                // time spent updating
+                  querySeconds = 0;                 // time spent querying
+  size_t          length;                           // length of the phrase
+  int             operations = BENCHMARK_OPERATIONS >> 4;
+
+  // consistency
+  if (numberOfWords < 2)
+    return;
+
+  for (int i = 0; i < operations; i++)
+  {
+    // eight words of the corpus, picked uniformly
+    length = 0;
+
+    for (int j = 0; j < 8; j++)
+      length += sprintf(phrase + length, "%s ", getWordSpelling(trie, 1 + getNextRandom(&state) % (numberOfWords - 1)));
 
-  return index;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    updateTrie(trie, phrase);
+    updateSeconds += getElapsedSeconds(&start);
+
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    getCompletions(trie, getWordSpelling(trie, 1 + i % (numberOfWords - 1)), 10, words);
+    querySeconds += getElapsedSeconds(&start);
+  }
+
+  reportMetric("update/phrase", "operations", operations);
+  reportMetric("update/phrase", "new nodes", trie->numberOfNodes - numberOfNodes);
+  reportMetric("update/phrase", "ns/op", updateSeconds * 1e9 / operations);
+  reportMetric("update/completion", "ns/op", querySeconds * 1e9 / operations);
 }
 
 /****************************************************************
- * Inserts a word into trie node. Returns last node.
+ * Auxiliary function. Compacts a trie, dropping the words seen
+ * once and the successors seen once, and keeping at most
+ * BENCHMARK_SUCCESSORS successors per word, and reports the memory
+ * saved. The prediction of every word kept is then compared with
+ * the one of a trie built again from the corpus, which should be
+ * the same, before the queries are timed.
  *
- * @param		node		      node of the trie
- * @param		word		      word to be inserted in the trie
- *
- * @return  TrieNode*     node of the trie that contains the last letter of the word
+ * @param		trie		      trie to be compacted
+ * @param		filename		  name of the corpus it was built from
  */
-TrieNode* insertWord (TrieNode* node, char* word)
+void runCompactBenchmark (Trie* trie, char* filename)
 {
-  TrieNode* child;    // child of the node
-  int       length;   // number of letters of the word
-  char      letter;   // letter
+  Trie*           whole;            // trie of the whole corpus
+  const TrieNode* node;             // node of a word in it
+  TrieWord*       word;             // record of a word kept
+  struct timespec start;            // start time of the compaction
+  double          seconds;          // time spent compacting
+  long            numberOfNodes,    // nodes before compacting
+                  unchanged = 0;    // words kept whose prediction is unchanged
+  unsigned int    numberOfWords;    // words before compacting
+  size_t          bytes;            // memory before compacting
 
   // consistency
-  if ((node == NULL) || (word == NULL))
-    return NULL;
+  if (trie == NULL)
+    return;
 
-  // gets length
-  length = strlen(word);
+  numberOfNodes = trie->numberOfNodes;
+  numberOfWords = trie->numberOfWords;
+  bytes = getTrieBytes(trie);
 
-  // consistency
-  if (length == 0)
-    return NULL;
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  if (!compactTrie(trie, 2, 2, BENCHMARK_SUCCESSORS))
+    return;
+  seconds = getElapsedSeconds(&start);
 
-  // gets first letter
-  letter = word[0];
+  reportMetric("compact", "seconds", seconds);
+  reportMetric("compact", "nodes before", numberOfNodes);
+  reportMetric("compact", "nodes", trie->numberOfNodes);
+  reportMetric("compact", "words before", numberOfWords - 1);
+  reportMetric("compact", "words", trie->numberOfWords - 1);
+  reportMetric("compact", "bytes before", bytes);
+  reportMetric("compact", "bytes", getTrieBytes(trie));
+  reportMetric("compact", "bytes saved", (double) bytes - getTrieBytes(trie));
 
-  // checks if letter already exists
-  if (node->children[getIndex(letter)] == NULL)
-  {
-    // creates node
-    child = createTrieNode();
+  // same prediction, by spelling, as in the whole trie
+  whole = buildTrieFromMappedFile(filename);
 
-    // links root and child
-    node->children[getIndex(letter)] = child;
-  }
-  else
+  for (unsigned int i = 1; (whole != NULL) && (i < trie->numberOfWords); i++)
   {
-    // we get the existing child
-    child = node->children[getIndex(letter)];
+    word = &trie->words[i];
+    node = getTrieNode(whole, whole->root, getWordSpelling(trie, i));
+
+    if ((node != NULL) && (node->word != 0) &&
+        (whole->words[node->word].predictionCount == word->predictionCount) &&
+        (strcmp(getWordSpelling(whole, whole->words[node->word].prediction),
+                getWordSpelling(trie, word->prediction)) == 0))
+      unchanged++;
   }
 
-  // checks if there are more characters
-  if (length > 1)
-  {
-    char substring[length-1];
-
-    // creates substring without already inserted letter
-    strcpy(substring, word +1);
-
-    // recursive call to add next letter
-    return insertWord(child, substring);
-  }
-  // length = 1 is the last letter
-  else
-  {
-    // increments word count
-    child->count++;
+  destroyTrie(whole);
 
-    // returns last node of the word
-    return child;
-  }
+  reportMetric("compact", "predictions unchanged", unchanged);
+  runLookupBenchmark(trie, "compacted");
 }
 
 /****************************************************************
- * Receives and runs command from file.
+ * Auxiliary function. Builds the bigram trie of a corpus with
+ * exact successor counts, packed, then with sketches of 4, 16 and
+ * 64 MB keeping SKETCH_DEFAULT_CANDIDATES successors per word, and
+ * reports the time and memory of each build, and how many words
+ * get the same prediction and the same chain of ten predicted
+ * words as with the exact counts; the agreement is also weighted
+ * by the occurrences of the words, since the rare ones mostly
+ * differ on ties between successors seen once.
  *
- * @param		root		      root of the trie
- * @param		filename		  name of the file with the commands
+ * @param		filename		  name of the file with the corpus
  */
-void runFileCommands (TrieNode* root, char* filename)
+void runSketchBenchmark (char* filename)
 {
-  FILE* file;                       // file with commands
-  char  command[MAX_CHARACTERS];    // command
-  int   length;                     // number of letters
-
-  if ((root == NULL) || (filename == NULL))
-    return;
-
-  // opens file
-  file = fopen(filename, "r");
+  Trie*           exact;            // trie with exact counts
+  Trie*           trie;             // trie with estimated counts
+  const TrieNode* node;             // node of a word in it
+  TrieOutput      expected = {0},   // chain of a word predicted with exact counts
+                  output = {0};     // the same chain with estimated counts
+  struct timespec start;            // start time of each build
+  char            name[32];         // name of each measurement
+  char*           word;             // spelling of a word
+  long            samePredictions,  // words with the same prediction
+                  sameChains,       // words with the same chain
+                  occurrences = 0,  // occurrences of all words
+                  sameOccurrences;  // occurrences of the words with the same prediction
+  size_t          sizes[] = {4 << 20, 16 << 20, 64 << 20};
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+  exact = buildTrie(filename);
 
   // consistency
-  if (file == NULL)
+  if ((exact == NULL) || !packTrie(exact))
   {
-    printf("\nError: Unable to open file %s.\n\n", filename);
+    destroyTrie(exact);
     return;
   }
 
-  // reads file line-by-line
-  while (fgets(command, MAX_CHARACTERS, file) != NULL)
-  {
-    length = strlen(command);
+  reportMetric("sketch/exact", "seconds", getElapsedSeconds(&start));
+
+  for (unsigned int j = 1; j < exact->numberOfWords; j++)
+    occurrences += getNode(exact, exact->words[j].node)->count;
 
-    // checks if a command was received
-    if (length > 0 )
+  reportMetric("sketch/exact", "successors", exact->numberOfSuccessors);
+  reportMetric("sketch/exact", "successor bytes", exact->numberOfSuccessors *
+               (double) (sizeof(TrieSuccessor) + sizeof(unsigned int)));
+
+  for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+  {
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    trie = buildTrieWithSketch(filename, sizes[i], SKETCH_DEFAULT_CANDIDATES, TRIE_ALPHABET_LETTERS);
+
+    // consistency
+    if (trie == NULL)
+      continue;
+
+    sprintf(name, "sketch/%zuM", sizes[i] >> 20);
+    reportMetric(name, "seconds", getElapsedSeconds(&start));
+    reportMetric(name, "sketch bytes", sizes[i]);
+    reportMetric(name, "successors", trie->numberOfSuccessors);
+    reportMetric(name, "successor bytes", trie->numberOfSuccessors *
+                 (double) (sizeof(TrieSuccessor) + sizeof(unsigned int)));
+
+    // same prediction and chain, by spelling, for every word
+    samePredictions = 0;
+    sameChains = 0;
+    sameOccurrences = 0;
+
+    for (unsigned int j = 1; j < exact->numberOfWords; j++)
     {
-      if (command[0] == '!')
-      {
-        // passes root of trie to be printed
-        eventCommand1(root);
-      }
-      else if (command[0] == '@')
-      {
-        // passes command without @: Contains string and number
-        eventCommand2(root, command+2);
+      word = getWordSpelling(exact, j);
+      node = getTrieNode(trie, trie->root, word);
 
-        // fixes display for multiple calls to text prediction command
-        printf("\n");
-      }
-      else
+      // consistency
+      if ((node == NULL) || (node->word == 0))
+        continue;
+
+      if (strcmp(getWordSpelling(exact, exact->words[j].prediction),
+                 getWordSpelling(trie, trie->words[node->word].prediction)) == 0)
       {
-        // passes string to be searched
-        eventCommand3(root, command);
+        samePredictions++;
+        sameOccurrences += node->count;
       }
+
+      getTextPrediction(exact, getNode(exact, exact->words[j].node), 10, &expected);
+      getTextPrediction(trie, node, 10, &output);
+
+      sameChains += (expected.length == output.length) && (memcmp(expected.text, output.text, output.length) == 0);
+      expected.length = 0;
+      output.length = 0;
     }
+
+    reportMetric(name, "words", exact->numberOfWords - 1);
+    reportMetric(name, "same prediction", samePredictions);
+    reportMetric(name, "same chain", sameChains);
+    reportMetric(name, "same prediction by occurrence %", 100.0 * sameOccurrences / occurrences);
+
+    destroyTrie(trie);
   }
 
-  // closes file
-  fclose(file);
+  free(expected.text);
+  free(output.text);
+  destroyTrie(exact);
 }
 
 /****************************************************************
- * Executes command to print trie.
+ * Auxiliary function. Measures the tokenization of the corpus
+ * alone, with no insertion: the character loop insertBlock had
+ * before, with a call to isalpha and tolower for every letter,
+ * then the scan of runs of letters, with each implementation the
+ * processor supports, in MB/s; last, the same scans in the bytes
+ * alphabet.
  *
- * @param		root		      root of the trie
+ * @param		filename		  name of the file with the corpus
  */
-void eventCommand1 (TrieNode* root)
+void runTokenizeBenchmark (char* filename)
 {
-  // prints trie with defined format
-  printTrieSimpleFormat(root);
-}
+  struct timespec start;                 // start time of each measurement
+  char*           text;                  // mapped corpus
+  char            name[48];              // name of each measurement
+  size_t          size;                  // size of the corpus
+  double          seconds;               // time spent scanning
+  long            checksum;              // letters of the words found
+  char*           names[] = {"bytes", "scalar", "sse2", "avx2"};
+  unsigned int    (*getMasks[]) (char*, int) =
+  {
+    NULL,
+    getLetterMaskScalar,
+#ifdef TRIE_SIMD
+    getLetterMaskSse2,
+    __builtin_cpu_supports("avx2") ? getLetterMaskAvx2 : NULL
+#endif
+  };
+  int             numberOfScans = sizeof(getMasks) / sizeof(getMasks[0]);
 
-/****************************************************************
- * Executes command for text prediction in trie.
- *
- * @param		root	        root of the trie
- * @param		phrase		    string with words
- */
-void eventCommand2 (TrieNode* root, char* phrase)
-{
-  TrieNode* node = NULL;                      // node of the trie
-  int       numberOfWords,                    // number of words
-            wordIndex = 0,                    // index of the word
-            numberIndex = 0;                  // index of the number
-  char      word[MAX_CHARACTERS_PER_WORD],    // word of the command
-            number[MAX_CHARACTERS_PER_WORD],  // number of the command
-            delimiter;                        // separator of words
+  text = mapFile(filename, &size, MADV_SEQUENTIAL);
 
   // consistency
-  if ((root == NULL) || (phrase == NULL))
+  if (text == NULL)
     return;
 
-  // initialize strings
-  strcpy(word, "");
-  strcpy(number, "");
+  for (int alphabet = TRIE_ALPHABET_LETTERS; alphabet <= TRIE_ALPHABET_BYTES; alphabet++)
+  {
+    for (int i = 0; i < numberOfScans; i++)
+    {
+      // no AVX2 on this processor, and no character loop for the bytes alphabet
+      if (((i > 0) || (alphabet != TRIE_ALPHABET_LETTERS)) && (getMasks[i] == NULL))
+        continue;
 
-  delimiter = ' ';
+      clock_gettime(CLOCK_MONOTONIC, &start);
+      checksum = countBlockWords(text, size, alphabet, getMasks[i]);
+      seconds = getElapsedSeconds(&start);
 
-  // removes word and number from phrase
-  for (int i = 0; i < strlen(phrase); i++)
+      sprintf(name, (alphabet == TRIE_ALPHABET_LETTERS) ? "tokenize/%s" : "tokenize/bytes-alphabet/%s", names[i]);
+      reportMetric(name, "checksum", checksum);
+      reportMetric(name, "MB/s", size / 1e6 / seconds);
+    }
+  }
+
+  munmap(text, size);
+}
+
+/****************************************************************
+ * Auxiliary function. Splits a text into words as insertBlock
+ * does, with a given classification of letters or, without one,
+ * one character at a time with isalpha and tolower, and sums the
+ * first and last letters of the words instead of inserting them,
+ * so that every scan can be checked against the others.
+ *
+ * @param		block		      text with words
+ * @param		length		    number of characters of the text
+ * @param		alphabet		  TRIE_ALPHABET_LETTERS or TRIE_ALPHABET_BYTES
+ * @param		getMask		    function that finds the letters among 32 characters, or NULL
+ *
+ * @return  long          sum of the first and last letters of the words
+ */
+long countBlockWords (char* block, size_t length, int alphabet, unsigned int (*getMask) (char*, int))
+{
+  char         word[MAX_CHARACTERS_PER_WORD];    // word being scanned
+  unsigned int letters = 0;                      // bit of each letter of the chunk, from the current character on
+  size_t       chunkEnd = 0,                     // end of the chunk of characters classified at once
+               wordLength = 0,                   // number of letters of the word
+               run,                              // number of letters from the current character on
+               room;                             // number of letters the word can still take
+  long         checksum = 0;                     // letters of the words found
+
+  for (size_t i = 0; i < length; )
   {
-    if (isalpha(phrase[i]) && phrase[i] != delimiter)
+    // letter by letter, as before
+    if ((getMask == NULL) && isalpha((unsigned char) block[i]))
     {
-      word[wordIndex] = phrase[i];
-      wordIndex++;
+      if (wordLength < MAX_CHARACTERS_PER_WORD - 1)
+        word[wordLength++] = tolower((unsigned char) block[i]);
+
+      i++;
+      continue;
     }
-    else if (isdigit(phrase[i]) && phrase[i] != delimiter)
+
+    if ((getMask != NULL) && (i == chunkEnd))
     {
-      number[numberIndex] = phrase[i];
-      numberIndex++;
+      chunkEnd = (i + TOKEN_CHUNK_SIZE <= length) ? i + TOKEN_CHUNK_SIZE : i + 1;
+      letters = (chunkEnd - i == TOKEN_CHUNK_SIZE) ? getMask(block + i, alphabet) : isLetter(block[i], alphabet);
     }
-  }
-
-  // adding end-of-line character
-  word[wordIndex] = '\0';
-  number[numberIndex] = '\0';
 
-  // converting string to integer
-  numberOfWords = atoi(number);
+    if (letters & 1)
+    {
+      run = (letters == UINT_MAX) ? TOKEN_CHUNK_SIZE : (size_t) __builtin_ctz(~letters);
+      room = MAX_CHARACTERS_PER_WORD - 1 - wordLength;
+      room = (run < room) ? run : room;
 
-  printf("%s", word);
+      copyLowercase(word + wordLength, block + i, room);
+      wordLength += room;
+      letters = (run < TOKEN_CHUNK_SIZE) ? letters >> run : 0;
+      i += run;
 
-  // gets node with given word
-  node = getTrieNode(root, word);
+      continue;
+    }
 
-  // consistency
-  if (node == NULL)
-    return;
+    if (((block[i] == ' ') || (block[i] == '\n')) && (wordLength > 0))
+    {
+      checksum += word[0] + word[wordLength - 1];
+      wordLength = 0;
+    }
 
-  else if (node->subtrie == NULL)
-    return;
+    letters >>= 1;
+    i++;
+  }
 
-  else
-    getTextPrediction (root, node, numberOfWords);
+  return checksum;
 }
 
 /****************************************************************
- * Executes command for word search in trie.
+ * Auxiliary function. Measures the query server under load. Each
+ * connection sends all the commands of a file, starting at its own
+ * share of the lines, and keeps up to depth requests in flight. The
+ * time from sending each request to receiving its whole answer is
+ * its latency; the throughput and the latency percentiles over all
+ * connections are printed as benchmark lines.
  *
- * @param		root	        root of the trie
- * @param		word		      string with word
+ * @param		socketPath		        path of the socket of the server
+ * @param		filename		          name of the file with the commands
+ * @param		numberOfConnections		number of connections, each on its own thread
+ * @param		depth		              most requests in flight on each connection
  */
-void eventCommand3 (TrieNode* root, char* word)
+void runLoadGenerator (char* socketPath, char* filename, int numberOfConnections, int depth)
 {
-  TrieNode* node = NULL;    // node of the trie
+  TrieLoadTask*   tasks;                 // one task per connection
+  pthread_t*      threads;               // one thread per connection
+  bool*           started;               // whether each thread was started
+  char**          lines;                 // start of each command
+  size_t*         lineLengths;           // length of each command, newline excluded
+  char*           text;                  // contents of the file
+  char*           newline;               // newline ending a command
+  double*         latencies;             // latencies of all connections
+  size_t          size;                  // size of the file
+  long            numberOfLines = 0,     // number of commands
+                  numberOfAnswers = 0,   // requests answered on all connections
+                  failures = 0;          // requests not answered
+  double          seconds;               // duration of the whole load
+  struct timespec start;                 // start time of the load
+  char*           percentiles[] = {"p50 us", "p90 us", "p99 us", "p99.9 us"};
+  double          ranks[] = {0.5, 0.9, 0.99, 0.999};
+
+  if (numberOfConnections < 1)
+    numberOfConnections = 1;
+
+  if (depth < 1)
+    depth = 1;
+
+  text = mapFile(filename, &size, MADV_SEQUENTIAL);
+
+  // consistency; an empty file has no commands
+  if (text == NULL)
+    return;
+
+  for (char* line = text; line < text + size; line = newline + 1)
+  {
+    newline = memchr(line, '\n', text + size - line);
+    numberOfLines++;
+
+    if (newline == NULL)
+      break;
+  }
+
+  lines = malloc(numberOfLines * sizeof(char*));
+  lineLengths = malloc(numberOfLines * sizeof(size_t));
+  tasks = calloc(numberOfConnections, sizeof(TrieLoadTask));
+  threads = calloc(numberOfConnections, sizeof(pthread_t));
+  started = calloc(numberOfConnections, sizeof(bool));
+  latencies = malloc(numberOfLines * numberOfConnections * sizeof(double));
 
   // consistency
-  if ((root == NULL) || (word == NULL))
+  if ((lines == NULL) || (lineLengths == NULL) || (tasks == NULL) || (threads == NULL) || (started == NULL)
+      || (latencies == NULL))
+  {
+    free(lines);
+    free(lineLengths);
+    free(tasks);
+    free(threads);
+    free(started);
+    free(latencies);
+    munmap(text, size);
     return;
+  }
 
-  // prints received string command on screen
-  printf("%s", word);
+  for (long i = 0, offset = 0; i < numberOfLines; i++)
+  {
+    newline = memchr(text + offset, '\n', size - offset);
+    lines[i] = text + offset;
+    lineLengths[i] = (newline != NULL) ? (size_t) (newline - lines[i]) : size - offset;
+    offset += lineLengths[i] + 1;
+  }
 
-  // searches for word in trie
-  node = getTrieNode(root, word);
+  clock_gettime(CLOCK_MONOTONIC, &start);
 
-  // checks if word was found in root trie. If not, exit
-  if (node == NULL)
+  for (int i = 0; i < numberOfConnections; i++)
   {
-    printf("(INVALID STRING)\n");
+    tasks[i].socketPath = socketPath;
+    tasks[i].lines = lines;
+    tasks[i].lineLengths = lineLengths;
+    tasks[i].numberOfLines = numberOfLines;
+    tasks[i].first = numberOfLines * i / numberOfConnections;
+    tasks[i].depth = depth;
+    tasks[i].latencies = latencies + numberOfLines * i;
+    started[i] = (pthread_create(&threads[i], NULL, runLoadTask, &tasks[i]) == 0);
+  }
 
-    // if node is null, it has no subtrie
-    return;
+  for (int i = 0; i < numberOfConnections; i++)
+  {
+    if (started[i])
+      pthread_join(threads[i], NULL);
+    else
+      tasks[i].failures = numberOfLines;
   }
 
-  // checks if word has a subtrie
-  if (node->subtrie == NULL)
-    printf("(EMPTY)\n");
+  seconds = getElapsedSeconds(&start);
 
-  // uses recursive call with hyphen as root
-  else
-    printTrieNodeWordsSimpleFormat(node->subtrie, "- ");
+  // gathers the latencies of all connections
+  for (int i = 0; i < numberOfConnections; i++)
+  {
+    memmove(latencies + numberOfAnswers, tasks[i].latencies, tasks[i].numberOfAnswers * sizeof(double));
+    numberOfAnswers += tasks[i].numberOfAnswers;
+    failures += tasks[i].failures;
+  }
+
+  qsort(latencies, numberOfAnswers, sizeof(double), compareLatencies);
+
+  printf("benchmark\tmetric\tvalue\n");
+  reportMetric("server", "connections", numberOfConnections);
+  reportMetric("server", "depth", depth);
+  reportMetric("server", "requests", numberOfAnswers);
+  reportMetric("server", "failures", failures);
+  reportMetric("server", "seconds", seconds);
+  reportMetric("server", "requests/s", numberOfAnswers / seconds);
+
+  for (int i = 0; (i < 4) && (numberOfAnswers > 0); i++)
+    reportMetric("server", percentiles[i], latencies[(long) (ranks[i] * (numberOfAnswers - 1))] * 1e6);
+
+  if (numberOfAnswers > 0)
+    reportMetric("server", "max us", latencies[numberOfAnswers - 1] * 1e6);
+
+  // deallocates memory
+  free(lines);
+  free(lineLengths);
+  free(tasks);
+  free(threads);
+  free(started);
+  free(latencies);
+  munmap(text, size);
 }
 
 /****************************************************************
- * Gets a list of all words in a node subtrie.
+ * Auxiliary function. Sends the commands of a file over one
+ * connection of the load generator, keeping up to depth of them
+ * in flight, and times the answer of each one.
  *
- * @param		root	        root of the trie
- * @param		listOfWords   string to be filled with the words, separated by whitespace
+ * @param		task		      task of the connection
+ *
+ * @return	void*         NULL, as required by pthread_create
  */
-void getTrieWords (TrieNode* root, char* listOfWords)
+void* runLoadTask (void* task)
 {
-  int   numberOfChildren;                     // number of children of root node
-  char  rootWord[MAX_CHARACTERS_PER_WORD],    // word to be completed by node content
-        letter[2];                            // first letter of the word
+  TrieLoadTask*      loadTask = task;        // task of this connection
+  struct sockaddr_un address = {0};          // address of the server
+  struct timespec    start;                  // start time of the connection
+  TrieOutput         requests = {0};         // requests not yet sent
+  TrieOutput         answers = {0};          // characters received and not yet read
+  double*            sendTimes;              // send time of each request in flight, by sequence number
+  size_t             consumed = 0,           // characters of the answers already read
+                     answerLength;           // length of the answer being read
+  char*              newline;                // end of the length line of an answer
+  ssize_t            received;               // characters received at once
+  long               sent = 0,               // requests sent
+                     line;                   // line of the next request
+  int                client;                 // socket of the connection
+
+  sendTimes = malloc(loadTask->depth * sizeof(double));
+  client = socket(AF_UNIX, SOCK_STREAM, 0);
+  address.sun_family = AF_UNIX;
+  strncpy(address.sun_path, loadTask->socketPath, sizeof(address.sun_path) - 1);
 
   // consistency
-  if (root == NULL)
-    return;
+  if ((sendTimes == NULL) || (client < 0) || (connect(client, (struct sockaddr*) &address, sizeof(address)) != 0))
+  {
+    printf("\nError: Unable to connect to %s.\n\n", loadTask->socketPath);
+    loadTask->failures = loadTask->numberOfLines;
+    free(sendTimes);
 
-  // gets number of children
-  numberOfChildren = getNumberOfChildren(root);
+    if (client >= 0)
+      close(client);
 
-  // if a child exists, cycles pointer through children
-  if (numberOfChildren > 0)
+    return NULL;
+  }
+
+  clock_gettime(CLOCK_MONOTONIC, &start);
+
+  while (loadTask->numberOfAnswers < loadTask->numberOfLines)
   {
+    // fills the pipeline, every request ending with a newline
+    while ((sent < loadTask->numberOfLines) && (sent - loadTask->numberOfAnswers < loadTask->depth))
+    {
+      line = (loadTask->first + sent) % loadTask->numberOfLines;
+      writeOutput(&requests, loadTask->lines[line], loadTask->lineLengths[line]);
+      writeOutput(&requests, "\n", 1);
+      sendTimes[sent % loadTask->depth] = getElapsedSeconds(&start);
+      sent++;
+    }
+
+    // consistency
+    if (!sendRequests(client, &requests))
+      break;
+
+    // reads the answers received so far, and waits for more if none is complete
+    newline = memchr(answers.text + consumed, '\n', answers.length - consumed);
+    answerLength = (newline != NULL) ? strtoul(answers.text + consumed, NULL, 10) : 0;
 
-    for (int i = 0; i < 26; i++)
+    if ((newline == NULL) || ((size_t) (answers.text + answers.length - newline - 1) < answerLength))
     {
-      if (root->children[i] != NULL)
-      {
-        // takes first letter of word and creates a string
-        letter[0] = 'a' + i;
-        letter[1] = '\0';
+      // consistency
+      if (!reserveOutput(&answers, OUTPUT_FLUSH_SIZE))
+        break;
 
-        // inserts first letter into word string
-        strcpy(rootWord, letter);
+      received = recv(client, answers.text + answers.length, answers.size - answers.length, 0);
 
-        // recursive call into child nodes
-        getTrieNodeWords(root->children[i], listOfWords, rootWord);
-      }
+      // consistency
+      if ((received < 0) && (errno == EINTR))
+        continue;
+      else if (received <= 0)
+        break;
+
+      answers.length += received;
+      continue;
+    }
+
+    loadTask->latencies[loadTask->numberOfAnswers] = getElapsedSeconds(&start)
+                                                     - sendTimes[loadTask->numberOfAnswers % loadTask->depth];
+    loadTask->numberOfAnswers++;
+    consumed = newline + 1 + answerLength - answers.text;
+
+    // drops the answers read
+    if (consumed == answers.length)
+    {
+      answers.length = 0;
+      consumed = 0;
+    }
+    else if (consumed > answers.size / 2)
+    {
+      memmove(answers.text, answers.text + consumed, answers.length - consumed);
+      answers.length -= consumed;
+      consumed = 0;
     }
   }
+
+  loadTask->failures = loadTask->numberOfLines - loadTask->numberOfAnswers;
+
+  // deallocates memory
+  close(client);
+  free(sendTimes);
+  free(requests.text);
+  free(answers.text);
+
+  return NULL;
 }
 
 /****************************************************************
- * Auxiliary function. Gets a list of all words in a node subtrie.
+ * Auxiliary function. Sends all the requests of an output on a
+ * blocking socket, and empties it.
  *
- * @param		node	        node of the trie
- * @param		listOfWords   string to be filled with the words, separated by whitespace
- * @param		word          string to be filled with letters of the word
+ * @param		client		    socket of the connection
+ * @param		requests		  requests to be sent
+ *
+ * @return  bool          true if all requests were sent; otherwise, false
  */
-void getTrieNodeWords (TrieNode* node, char* listOfWords, char* word)
+bool sendRequests (int client, TrieOutput* requests)
 {
-  int   numberOfChildren;                     // number of children of this node
-  char  nodeWord[MAX_CHARACTERS_PER_WORD],    // word from this node forward
-        letter[2];                            // letter corresponding to this node
-
-  // consistency
-  if (node == NULL)
-    return;
+  ssize_t sent;     // characters sent at once
 
-  // when the count is greater than zero, it has reached the end of a word
-  if (node->count > 0)
+  for (size_t offset = 0; offset < requests->length; offset += sent)
   {
-    strcat(listOfWords, word);
-    strcat(listOfWords, " ");
-  }
+    sent = send(client, requests->text + offset, requests->length - offset, MSG_NOSIGNAL);
 
-  // gets number of children
-  numberOfChildren = getNumberOfChildren(node);
+    if ((sent < 0) && (errno == EINTR))
+      sent = 0;
+    else if (sent < 0)
+      return false;
+  }
 
-  // if a child exists, cycles through nodes to append letters to the word
-  if (numberOfChildren > 0)
-  {
-    for (int i = 0; i < 26; i++)
-    {
-      if (node->children[i] != NULL)
-      {
-        // current letter
-        letter[0] = 'a' + i;
-        letter[1] = '\0';
+  requests->length = 0;
 
-        // copies received partial word into final word string
-        strcpy(nodeWord, word);
+  return true;
+}
 
-        // appends next letter into final word string
-        strcat(nodeWord, letter);
+/****************************************************************
+ * Auxiliary function. Orders latencies, shortest first, for qsort.
+ *
+ * @param		item		      latency
+ * @param		other		      latency it is compared to
+ *
+ * @return  int           negative, zero or positive as the first latency is shorter, equal or longer
+ */
+int compareLatencies (const void* item, const void* other)
+{
+  double latency = *(const double*) item,         // first latency
+         otherLatency = *(const double*) other;   // second latency
 
-        // recursive call to print child nodes
-        getTrieNodeWords(node->children[i], listOfWords, nodeWord);
-      }
-    }
-  }
+  return (latency > otherLatency) - (latency < otherLatency);
 }
 
-
 /****************************************************************
- * ...
- * @param		node	        node of the trie
+ * Auxiliary function. Prints one measurement of the benchmark.
  *
- * @return  TrieNode*     node with the most frequent word
+ * @param		benchmark		  name of the benchmark
+ * @param		metric		    name of the measurement, with its unit
+ * @param		value		      value measured
  */
-void getTextPrediction (TrieNode* root, TrieNode* node, int counter)
+void reportMetric (char* benchmark, char* metric, double value)
 {
-  int       wordIndex = 0,                             // index of the word
-            maxFrequency = 0;                          // count of most frequent word
-  char      word[MAX_CHARACTERS_PER_WORD],             // word of the command
-            mostFrequentWord[MAX_CHARACTERS_PER_WORD], // word of the command
-            listOfWords[MAX_CHARACTERS],               // list of all subtrie words
-            delimiter;                                 // separator of words
-  TrieNode* nextWord = NULL;
+  printf("%s\t%s\t%.15g\n", benchmark, metric, value);
+}
 
+/****************************************************************
+ * Writes a synthetic corpus on screen. Words are drawn from a
+ * vocabulary that grows with the corpus, with Zipf-distributed
+ * frequencies, so a few words are very common and most are rare,
+ * as in natural text. Lines hold 1 to MAX_WORDS_PER_LINE words,
+ * and start with a capital letter and end with a period. The
+ * corpus is written as it is generated, so its size is only
+ * bounded by the disk.
+ *
+ * @param		size		      number of characters to write, rounded up to a whole line
+ * @param		seed		      seed of the random numbers; equal seeds give equal corpora
+ */
+void generateCorpus (long long size, unsigned long long seed)
+{
+  double*   frequencies;                      // cumulative frequency of each rank
+  char*     block;                            // characters not yet written
+  char      word[16];                         // spelling of a word
+  double    total = 0,                        // sum of the frequencies
+            sample;                           // random number in [0, total)
+  long long written = 0;                      // number of characters written
+  size_t    length = 0;                       // number of characters in the block
+  unsigned long long state = seed * 2654435761u + 1;   // state of the random numbers
+  unsigned int vocabularySize,                // number of distinct words
+               low, high, middle;             // bounds of the rank search
+  int       numberOfWords;                    // number of words of the line
 
   // consistency
-  if ((node == NULL) || (counter == 0))
+  if (size <= 0)
     return;
 
-  // sets space as delimiter
-  delimiter = ' ';
+  // about one new word per 64 characters, as in English text
+  vocabularySize = (size / 64 < 256) ? 256 : (size / 64 > (1 << 22)) ? (1 << 22) : size / 64;
 
-  // initialize strings
-  strcpy(listOfWords, "");
+  frequencies = malloc(vocabularySize * sizeof(double));
+  block = malloc(READ_BLOCK_SIZE + MAX_CHARACTERS);
 
-  // resets word index
-  wordIndex = 0;
+  // consistency
+  if ((frequencies == NULL) || (block == NULL))
+  {
+    free(frequencies);
+    free(block);
+    return;
+  }
 
-  // gets list of words in subtrie
-  getTrieWords(node->subtrie, listOfWords);
+  // the word of rank r has frequency 1 / (r + 1)^s
+  for (unsigned int rank = 0; rank < vocabularySize; rank++)
+  {
+    total += 1.0 / pow(rank + 1, ZIPF_EXPONENT);
+    frequencies[rank] = total;
+  }
 
-  // searches most frequent word from list of words
-  // reads word by word from list of words
-  for (int i = 0; i < strlen(listOfWords); i++)
+  while (written < size)
   {
-    // gets word, using space and EOL as delimiters
-    if ((listOfWords[i] != delimiter) && listOfWords[i] != '\0')
-    {
-      word[wordIndex] = listOfWords[i];
-      wordIndex++;
-    }
-    // if a space or EOL is found, finalize string
-    else if ((listOfWords[i] == delimiter) || listOfWords[i] == '\0')
+    numberOfWords = 1 + getNextRandom(&state) % MAX_WORDS_PER_LINE;
+
+    for (int i = 0; i < numberOfWords; i++)
     {
-      word[wordIndex] = '\0';
+      // finds first rank whose cumulative frequency exceeds the sample
+      sample = (getNextRandom(&state) >> 11) * (1.0 / (1ULL << 53)) * total;
+      low = 0;
+      high = vocabularySize - 1;
 
-      if (getTrieNode(node->subtrie, word) != NULL)
+      while (low < high)
       {
-        if (maxFrequency < getTrieNode(node->subtrie, word)->count)
-        {
-          maxFrequency = getTrieNode(node->subtrie, word)->count;
-          strcpy(mostFrequentWord, word);
-        }
+        middle = (low + high) / 2;
+
+        if (frequencies[middle] > sample)
+          high = middle;
+        else
+          low = middle + 1;
       }
-      strcpy(word, "");
-      wordIndex = 0;
+
+      getGeneratedWord(low, word);
+
+      if (i == 0)
+        word[0] = toupper(word[0]);
+
+      if (i > 0)
+        block[length++] = ' ';
+
+      strcpy(block + length, word);
+      length += strlen(word);
+    }
+
+    block[length++] = '.';
+    block[length++] = '\n';
+
+    // writes full blocks
+    if (length >= READ_BLOCK_SIZE)
+    {
+      fwrite(block, 1, length, stdout);
+      written += length;
+      length = 0;
     }
+
+    if (written + (long long) length >= size)
+      break;
   }
 
-  // prints word on screen
-  printf(" %s", mostFrequentWord);
+  fwrite(block, 1, length, stdout);
+
+  free(frequencies);
+  free(block);
+}
 
-  // gets next word from root
-  nextWord = getTrieNode(root, mostFrequentWord);
+/****************************************************************
+ * Auxiliary function. Spells the word of a rank of the generated
+ * vocabulary. Ranks are written in bijective base 26 past the
+ * one-letter words, so every rank has its own word and frequent
+ * words are short.
+ *
+ * @param		rank		      rank of the word
+ * @param		word		      buffer to store the spelling, of at least 16 characters
+ */
+void getGeneratedWord (unsigned int rank, char* word)
+{
+  char          letters[16];    // letters, from the right
+  int           length = 0;     // number of letters
+  unsigned long number = rank + 27ul;
 
-  // consistency
-  if (nextWord == NULL)
-    return;
+  while (number > 0)
+  {
+    number--;
+    letters[length++] = 'a' + number % 26;
+    number /= 26;
+  }
 
-  else if (nextWord->subtrie == NULL)
-    return;
+  for (int i = 0; i < length; i++)
+    word[i] = letters[length - 1 - i];
 
-  else getTextPrediction(root, nextWord, counter-1);
+  word[length] = '\0';
 }
 
 /****************************************************************
- * Removes punctuation marks from string.
+ * Auxiliary function. Gives the next number of a xorshift64*
+ * sequence.
+ *
+ * @param		state		      state of the sequence, which must not be zero
  *
- * @param		string	      string with letters and punctuators
+ * @return	unsigned long long  random number
  */
-void stripPunctuators (char* string)
+unsigned long long getNextRandom (unsigned long long* state)
 {
-  int   index = 0;                    // index
-  char  newString[strlen(string)];    // new string without punctuators
+  *state ^= *state >> 12;
+  *state ^= *state << 25;
+  *state ^= *state >> 27;
 
-  // consistency
-  if (string == NULL)
-    return;
+  return *state * 2685821657736338717ULL;
+}
+
+/****************************************************************
+ * Auxiliary function. Reads a number of bytes, with an optional
+ * K, M or G suffix for powers of 1024.
+ *
+ * @param		text		      number, such as 64K or 10G
+ *
+ * @return	long long     number of bytes
+ */
+long long parseSize (char* text)
+{
+  char*     suffix;     // first character after the number
+  long long size;       // number of bytes
+
+  size = strtoll(text, &suffix, 10);
 
-  // traverses string
-  for (int counter = 0; counter < strlen(string); counter++)
+  switch (toupper(*suffix))
   {
-    // If the char is alphabetic, copy into new string
-    if(isalpha(string[counter]) || (string[counter]==' '))
-    {
-      // transforms char into lowercase
-      newString[index] = tolower(string[counter]);
-      index++;
-    }
+    case 'G':
+      size *= 1024;
+      // fall through
+    case 'M':
+      size *= 1024;
+      // fall through
+    case 'K':
+      size *= 1024;
   }
 
-  // adds end-of-line character
-  newString[index] = '\0';
+  return size;
+}
+
+/****************************************************************
+ * Gets seconds elapsed since a given time.
+ *
+ * @param		start		      time the measurement started
+ *
+ * @return  double        elapsed seconds
+ */
+double getElapsedSeconds (struct timespec* start)
+{
+  struct timespec now;   // current time
+
+  clock_gettime(CLOCK_MONOTONIC, &now);
 
-  // copies new string into original string
-  strcpy(string, newString);
+  return (now.tv_sec - start->tv_sec) + (now.tv_nsec - start->tv_nsec) / 1e9;
 }
 
 /****************************************************************
@@ -1,28 +1,550 @@
 #ifndef __TRIE_PREDICTION_H
 #define __TRIE_PREDICTION_H
 
+#include <stddef.h>
+#include <stdbool.h>
+#include <pthread.h>
+
 #define MAX_WORDS_PER_LINE 30
 #define MAX_CHARACTERS_PER_WORD 1023
 
+// number of nodes carved from each slab of the trie node pool
+#define TRIE_SLAB_BITS 16
+#define TRIE_SLAB_SIZE (1 << TRIE_SLAB_BITS)
+
+// longest context of the n-gram model, in words, successor included
+#define TRIE_MAX_ORDER 8
+
+// kinds of commands, and latency buckets of each kind, in the statistics
+#define TRIE_COMMAND_KINDS 7
+#define TRIE_LATENCY_BUCKETS 40
+
+// identification of snapshot files
+#define TRIE_SNAPSHOT_MAGIC "TRIESNAP"
+#define TRIE_SNAPSHOT_VERSION 6
+
+// alphabets of the words: letters a to z, or letters, digits and
+// every byte of 0x80 and above, which keeps UTF-8 characters whole
+#define TRIE_ALPHABET_LETTERS 0
+#define TRIE_ALPHABET_BYTES 1
 
+
+// Nodes refer to each other by 32-bit ids: the upper bits select the
+// slab and the lower TRIE_SLAB_BITS the node inside it. Id 0 is the
+// root of the main trie, which no node points to, so 0 also means none.
 typedef struct TrieNode
 {
 	// number of times this string occurs in the corpus
 	int count;
 
-	// 26 TrieNode pointers, one for each letter of the alphabet
-	struct TrieNode *children[26];
+	// first child, kept in alphabetical (byte) order through the sibling links
+	unsigned int child;
+
+	// next child of the parent node
+	unsigned int sibling;
 
 	// the co-occurrence subtrie for this string
-	struct TrieNode *subtrie;
+	unsigned int subtrie;
+
+	// id of the word record of this string, if it is a word; in the
+	// root of the subtrie of a context of two or more words, id of
+	// the node of its most frequent successor instead
+	unsigned int word;
+
+	// letter of the edge that leads to this node
+	char letter;
+
+	// number of letters of the edge after the first one, in a
+	// compressed trie; they are kept in the labels text, see compressTrie
+	unsigned char labelLength;
 } TrieNode;
 
 
+// One record per distinct word of the main trie. Record 0 is the
+// empty string and means none. Nodes that end a word in a subtrie
+// share the record of the same word in the main trie.
+typedef struct TrieWord
+{
+	// id of the node that ends this word in the main trie
+	unsigned int node;
+
+	// offset of the spelling of this word in the spellings buffer
+	unsigned int spelling;
+
+	// most frequent word that follows this one, ties broken
+	// alphabetically, and how many times it follows it
+	unsigned int prediction;
+	int predictionCount;
+} TrieWord;
+
+
+// Rank of a node: the largest word count below it, the node
+// included, and the alphabetically first word with that count.
+typedef struct TrieRank
+{
+	unsigned int count;
+	unsigned int word;
+} TrieRank;
+
+
+// Word that follows another one, by word id, and how many times it
+// does: an entry of the successor arrays of a packed trie, and an
+// answer of a ranked query.
+typedef struct TrieSuccessor
+{
+	unsigned int word;
+	int count;
+} TrieSuccessor;
+
+
+// Approximate counts of the word pairs of a corpus, in memory that
+// does not grow with the number of distinct pairs: a count-min
+// sketch, and the few successors of each word with the largest
+// estimates so far, its candidates for the predictions.
+typedef struct TrieSketch
+{
+	// depth rows of width counters each; width is a power of two
+	unsigned int *counters;
+	unsigned int width;
+	unsigned int depth;
+
+	// numberOfCandidates entries per word, by word id, for the
+	// first candidateTableSize words; unused ones have a count of 0
+	TrieSuccessor *candidates;
+	unsigned int numberOfCandidates;
+	unsigned int candidateTableSize;
+} TrieSketch;
+
+
+typedef struct Trie
+{
+	// root of the trie
+	TrieNode *root;
+
+	// slabs the nodes are carved from, released in bulk by destroyTrie
+	TrieNode **slabs;
+
+	// number of slabs in use and capacity of the slab table
+	int numberOfSlabs;
+	int slabTableSize;
+
+	// number of nodes already taken from the last slab
+	int slabNodesUsed;
+
+	// total number of nodes in the trie, subtries included
+	long numberOfNodes;
+
+	// word records, indexed by word id
+	TrieWord *words;
+	unsigned int numberOfWords;
+	unsigned int wordTableSize;
+
+	// null-terminated spellings of all words, back to back
+	char *spellings;
+	unsigned int spellingsLength;
+	unsigned int spellingsSize;
+
+	// n-gram order: every node of a context of up to order - 2 words
+	// has a subtrie of the words that follow it, once the context
+	// has been seen minimumContextCount times
+	int order;
+	int minimumContextCount;
+
+	// rank of each node of the main trie and of the successor
+	// subtries, indexed by node id; built by the first completion or
+	// successor query and kept current by updates
+	TrieRank *ranks;
+
+	// whether each node's children sit at the distance of their
+	// letter from its first child; see freezeTrie
+	bool frozen;
+
+	// characters words are made of, TRIE_ALPHABET_LETTERS or
+	// TRIE_ALPHABET_BYTES; the others are dropped from the words
+	int alphabet;
+
+	// letters of the compressed edges, back to back, and the offset of
+	// those of each node in them, indexed by node id and only read for
+	// the nodes whose labelLength is not 0; NULL unless compressed
+	unsigned int *labels;
+	char *labelText;
+	unsigned int labelTextLength;
+
+	// successors of every word once packed, instead of subtries: those
+	// of word i are entries successorOffsets[i] to successorOffsets[i + 1]
+	// - 1, in alphabetical order, and successorRanking lists the same
+	// entries by count, most frequent first; NULL unless packed
+	unsigned int *successorOffsets;
+	TrieSuccessor *successors;
+	unsigned int *successorRanking;
+	unsigned int numberOfSuccessors;
+
+	// counts of the word pairs while a sketch build runs, instead of
+	// subtries; its candidates end up in the successor arrays, see
+	// buildTrieWithSketch; NULL otherwise
+	TrieSketch *sketch;
+
+	// how '@' predicts: by default, the most frequent successor at each
+	// step; with a beam width, the most likely chain among those kept
+	// at each step; with a sample size, successors drawn among that
+	// many most frequent ones, the temperature sharpening (below 1) or
+	// flattening their weights, from a seed; see setPredictionMode
+	int beamWidth;
+	int sampleSize;
+	double temperature;
+	unsigned long long seed;
+
+	// snapshot file the nodes, records and spellings live in, if
+	// loaded and not updated since
+	void *mapping;
+	size_t mappingSize;
+} Trie;
+
+
+// Header of a snapshot file. It is followed by the nodes in id
+// order, the word records, the spellings, if packed, the successor
+// arrays and, if compressed, the labels, each at the offset recorded
+// here. Nodes and records refer to each other by id, so the file is
+// mapped and queried in place, with no deserialization.
+typedef struct TrieSnapshotHeader
+{
+	// TRIE_SNAPSHOT_MAGIC and TRIE_SNAPSHOT_VERSION
+	char magic[8];
+	unsigned int version;
+
+	// layout of the program that wrote the file
+	unsigned int nodeSize;
+	unsigned int wordSize;
+	unsigned int slabBits;
+
+	// n-gram order and pruning threshold of the trie
+	unsigned int order;
+	unsigned int minimumContextCount;
+
+	// number of nodes, word records and spelling characters
+	unsigned long long numberOfNodes;
+	unsigned int numberOfWords;
+	unsigned int spellingsLength;
+
+	// whether the nodes are laid out by freezeTrie, and alphabet of the words
+	unsigned int frozen;
+	unsigned int alphabet;
+
+	// whether the successors are packed by packTrie, and their number
+	unsigned int packed;
+	unsigned int numberOfSuccessors;
+
+	// whether the edges are compressed by compressTrie, and the number
+	// of characters of their labels
+	unsigned int compressed;
+	unsigned int labelTextLength;
+
+	// offsets of the sections, from the start of the file
+	unsigned long long nodesOffset;
+	unsigned long long wordsOffset;
+	unsigned long long spellingsOffset;
+	unsigned long long successorsOffset;
+	unsigned long long labelsOffset;
+} TrieSnapshotHeader;
+
+
+// Positions taken while freezing a trie: which slots hold a node,
+// which bases are used, and the new id of each node.
+typedef struct TrieFreezer
+{
+	bool *slots;
+	bool *bases;
+
+	// next slot worth trying as a first child, from each slot, and
+	// how many times each slot failed as one
+	unsigned int *next;
+	unsigned char *failures;
+	size_t size;
+
+	unsigned int *positions;
+	unsigned int numberOfSlots;
+} TrieFreezer;
+
+
+// State of a corpus being read block by block: the word being
+// scanned and the word before it, carried from one block to the next.
+typedef struct TrieReader
+{
+	// node of the previous word of the current line, in the main trie
+	TrieNode *previousWordNode;
+
+	// lowercase letters of the word being scanned
+	char word[MAX_CHARACTERS_PER_WORD];
+	int wordLength;
+
+	// nodes of the contexts of two or more words that end at the
+	// previous word, shortest first, for tries of order above 2
+	TrieNode *contextNodes[TRIE_MAX_ORDER - 2];
+} TrieReader;
+
+
+// Chunk of a corpus inserted into a private trie by one thread,
+// which is later merged with the tries of the other chunks.
+typedef struct TrieBuildTask
+{
+	// trie of this chunk, and trie of another chunk to be merged into it
+	Trie *trie;
+	Trie *source;
+
+	// characters of the chunk, which ends at a line boundary
+	char *text;
+	size_t length;
+
+	// whether merging the other trie ran out of memory
+	bool failed;
+} TrieBuildTask;
+
+
+// Output of commands, collected in memory and written in one go.
+typedef struct TrieOutput
+{
+	char *text;
+	size_t length;
+	size_t size;
+} TrieOutput;
+
+
+// Answer of a command already run in a batch, which is a range
+// of the batch output.
+typedef struct TrieMemoEntry
+{
+	// key of the command, in the key arena of the memo
+	size_t key;
+	unsigned int keyLength;
+	unsigned int hash;
+
+	// range of the output with the answer
+	size_t offset;
+	size_t length;
+} TrieMemoEntry;
+
+
+// Hash table of the answers of a batch, keyed by the normalized
+// command: the word and count of a prediction, or the line of a
+// word lookup.
+typedef struct TrieQueryMemo
+{
+	// open-addressing table, whose size is a power of two
+	TrieMemoEntry *entries;
+	unsigned int numberOfEntries;
+	unsigned int tableSize;
+
+	// keys of all entries, back to back
+	char *keys;
+	size_t keysLength;
+	size_t keysSize;
+} TrieQueryMemo;
+
+
+// Chunk of a command file answered by one thread, into an output
+// of its own which is written after the outputs of earlier chunks.
+typedef struct TrieQueryTask
+{
+	// trie to be queried
+	Trie *trie;
+
+	// characters of the chunk, which ends at a line boundary
+	char *text;
+	size_t length;
+
+	// answers of the chunk, and number of commands answered
+	TrieOutput output;
+	long numberOfCommands;
+} TrieQueryTask;
+
+
+// Client connected to the query server: the requests it sent that
+// are not answered yet, and the answers not yet sent back.
+typedef struct TrieConnection
+{
+	int socket;
+
+	// characters received, which end with an incomplete request
+	char *input;
+	size_t inputLength;
+	size_t inputSize;
+
+	// answers, of which the first outputSent characters are sent
+	TrieOutput output;
+	size_t outputSent;
+
+	// events the connection waits for, and whether the client
+	// sent all its requests
+	unsigned int events;
+	bool closing;
+
+	// other connections of the same thread
+	struct TrieConnection *previous;
+	struct TrieConnection *next;
+} TrieConnection;
+
+
+// Event loop of one thread of the query server, which accepts
+// connections on the shared socket and answers their requests.
+typedef struct TrieServerTask
+{
+	// trie to be queried, and lock that lets updates run alone
+	Trie *trie;
+	pthread_rwlock_t *lock;
+
+	// listening socket, shared by all threads
+	int listener;
+
+	// answer of the current request, and number of requests answered
+	TrieOutput answer;
+	long numberOfRequests;
+} TrieServerTask;
+
+
+// Connection of the load generator, which sends the requests of a
+// command file to the query server and times their answers.
+typedef struct TrieLoadTask
+{
+	// path of the socket of the server
+	char *socketPath;
+
+	// requests to send, one line each, starting at line first
+	char **lines;
+	size_t *lineLengths;
+	long numberOfLines;
+	long first;
+
+	// most requests sent and not yet answered
+	int depth;
+
+	// seconds from each send to its answer, in the order sent, and
+	// number of requests that got no answer
+	double *latencies;
+	long numberOfAnswers;
+	long failures;
+} TrieLoadTask;
+
+
+// Item of the best-first search of completions and successors: a
+// subtrie, keyed by its rank, or a word, keyed by its count and
+// spelling.
+typedef struct TrieCompletion
+{
+	unsigned int key;
+	unsigned int node;
+	unsigned int word;
+	bool subtrie;
+} TrieCompletion;
+
+
+// Chain of the beam search of predictions, kept at one step: its
+// last word, the chain of the previous step it extends, and the
+// log-probability of all its words.
+typedef struct TrieBeamEntry
+{
+	unsigned int word;
+	int parent;
+	double score;
+} TrieBeamEntry;
+
+
+// Counters of the instrumentation layer, which is compiled in with
+// -DTRIE_STATS and compiled out otherwise. Latencies are counted in
+// buckets of powers of two nanoseconds, one histogram per kind of
+// command: trie print, prediction, word search, statistics,
+// completion, bounded successor listing and update.
+typedef struct TrieStats
+{
+	// allocations
+	long nodeAllocations;
+	long slabAllocations;
+	long wordAllocations;
+
+	// calls of the hot paths, and nodes they visit
+	long insertions;
+	long insertVisits;
+	long lookups;
+	long lookupVisits;
+	long predictions;
+	long predictionVisits;
+	long siblingVisits;
+
+	// build time, and number and latency of commands
+	double buildSeconds;
+	long memoHits;
+	long commands[TRIE_COMMAND_KINDS];
+	long latencies[TRIE_COMMAND_KINDS][TRIE_LATENCY_BUCKETS];
+} TrieStats;
+
+
 // Functional Prototypes
 
-TrieNode *buildTrie(char *filename);
+Trie *buildTrie(char *filename);
+
+Trie *buildTrieOfOrder(char *filename, int order, int minimumContextCount, int alphabet);
+
+Trie *buildTrieFromMappedFile(char *filename);
+
+Trie *buildTrieInParallel(char *filename, int numberOfThreads, int alphabet);
+
+Trie *buildTrieWithSketch(char *filename, size_t sketchSize, int numberOfCandidates, int alphabet);
+
+Trie *destroyTrie(Trie *trie);
+
+bool saveTrie(Trie *trie, char *filename);
+
+Trie *loadTrie(char *filename);
+
+bool updateTrie(Trie *trie, char *phrase);
+
+bool updateTrieFromFile(Trie *trie, char *filename);
+
+bool freezeTrie(Trie *trie);
+
+bool packTrie(Trie *trie);
+
+bool compressTrie(Trie *trie);
+
+bool compactTrie(Trie *trie, int minimumWordCount, int minimumSuccessorCount, int maximumSuccessors);
+
+void setPredictionMode(Trie *trie, int beamWidth, int sampleSize, double temperature, unsigned long long seed);
+
+void runFileCommands(Trie *trie, char *filename);
+
+void runBatchCommands(Trie *trie, char *filename);
+
+void runParallelCommands(Trie *trie, char *filename, int numberOfThreads);
+
+bool serveTrie(Trie *trie, char *socketPath, int numberOfThreads);
+
+
+// Query Prototypes
+// They modify neither the trie nor the strings they are given, so
+// once a trie is built any number of threads can query it at once,
+// each one writing to an output of its own. The exception is the
+// update command, '+', which must run alone.
+
+const TrieNode *getTrieNode(Trie *trie, TrieNode *root, char *word);
+
+void runCommand(Trie *trie, char *command, TrieOutput *output);
+
+void eventCommand1(Trie *trie, TrieOutput *output);
+
+void eventCommand2(Trie *trie, char *phrase, TrieOutput *output);
+
+void eventCommand3(Trie *trie, char *word, TrieOutput *output);
+
+void eventCommand4(Trie *trie, TrieOutput *output);
+
+void eventCommand5(Trie *trie, char *phrase, TrieOutput *output);
+
+void eventCommand6(Trie *trie, char *phrase, bool alphabetical, TrieOutput *output);
+
+void eventCommand7(Trie *trie, char *phrase, TrieOutput *output);
+
+int getCompletions(Trie *trie, char *prefix, int numberOfCompletions, TrieSuccessor *words);
 
-TrieNode *destroyTrie(TrieNode *root);
+int getSuccessors(Trie *trie, char *word, int numberOfSuccessors, bool alphabetical, TrieSuccessor *words);
 
 double difficultyRating(void);
 